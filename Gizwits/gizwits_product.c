@@ -14,6 +14,7 @@
 *
 ***********************************************************/
 
+#define LOG_MODULE LOG_MODULE_PRODUCT
 #include <stdio.h>
 #include <string.h>
 #include "gizwits_product.h"
@@ -21,6 +22,12 @@
 #include "usart.h"
 #include "tim.h"
 #include "stmFlash.h"
+#include "settings.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "log.h"
+#include "sensorFilter.h"
+#include "backlog.h"
 
 static uint32_t timerMsCount;
 
@@ -30,7 +37,28 @@ dataPoint_t currentDataPoint;
 uint16_t localArray[128];
 uint16_t tempAndHumi[2];//0:温度设定值，1：湿度设定值
 
-#define FLASH_SAVE_ADDR  0X0800F000		//设置FLASH 保存地址(必须为偶数，且其值要大于本代码所占用FLASH的大小+0X08000000)
+#define USER_FILTER_PERIOD_MS	1000		//prefilter sample period: a window of 8 spans 8 s of PLC readings
+
+static sensorFilter_t userFilter[5];
+static uint32_t userFilterTick;
+
+/**
+* A PLC reading through the prefilter selected by its settings key. The filter
+* takes a sample every USER_FILTER_PERIOD_MS; with the filter off the reading
+* goes straight through.
+*/
+static uint32_t userFiltered(sensorFilter_t *filter, uint16_t raw, uint16_t key, uint32_t current, uint8_t sample)
+{
+	uint16_t mode = settingsGet(key, SENSOR_FILTER_OFF);
+
+	if (sample)
+	{
+		return sensorFilterSample(filter, raw, mode);
+	}
+	return SENSOR_FILTER_ACTIVE(mode) ? current : raw;
+}
+
+#define FLASH_SAVE_ADDR  0X0800F000		//设置FLASH 保存地址(必须为偶数，且其值要大于本代码所占用FLASH的大小+0X08000000)，现为settings存储区首页
 
 
 int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *gizdata, uint32_t len)
@@ -57,7 +85,7 @@ int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *gizdata, uint32_t len)
 		{
 		case EVENT_SW_KongTiao:
 			currentDataPoint.valueSW_KongTiao = dataPointPtr->valueSW_KongTiao;
-			GIZWITS_LOG("Evt: EVENT_SW_KongTiao %d \n", currentDataPoint.valueSW_KongTiao);
+			LOG_INFO("Evt: EVENT_SW_KongTiao %d \n", currentDataPoint.valueSW_KongTiao);
 			if (0x01 == currentDataPoint.valueSW_KongTiao)
 			{
 				//user handle
@@ -71,7 +99,7 @@ int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *gizdata, uint32_t len)
 			break;
 		case EVENT_SW_ZhiBan:
 			currentDataPoint.valueSW_ZhiBan = dataPointPtr->valueSW_ZhiBan;
-			GIZWITS_LOG("Evt: EVENT_SW_ZhiBan %d \n", currentDataPoint.valueSW_ZhiBan);
+			LOG_INFO("Evt: EVENT_SW_ZhiBan %d \n", currentDataPoint.valueSW_ZhiBan);
 			if (0x01 == currentDataPoint.valueSW_ZhiBan)
 			{
 				//user handle
@@ -85,7 +113,7 @@ int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *gizdata, uint32_t len)
 			break;
 		case EVENT_SW_FuYa:
 			currentDataPoint.valueSW_FuYa = dataPointPtr->valueSW_FuYa;
-			GIZWITS_LOG("Evt: EVENT_SW_FuYa %d \n", currentDataPoint.valueSW_FuYa);
+			LOG_INFO("Evt: EVENT_SW_FuYa %d \n", currentDataPoint.valueSW_FuYa);
 			if (0x01 == currentDataPoint.valueSW_FuYa)
 			{
 				//user handle
@@ -101,19 +129,19 @@ int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *gizdata, uint32_t len)
 
 		case EVENT_WenDuSet:
 			currentDataPoint.valueWenDuSet = dataPointPtr->valueWenDuSet;
-			GIZWITS_LOG("Evt:EVENT_WenDuSet %d\n", currentDataPoint.valueWenDuSet);
+			LOG_INFO("Evt:EVENT_WenDuSet %d\n", currentDataPoint.valueWenDuSet);
 			//user handle
 			localArray[5] = currentDataPoint.valueWenDuSet;
 			break;
 		case EVENT_ShiDuSet:
 			currentDataPoint.valueShiDuSet = dataPointPtr->valueShiDuSet;
-			GIZWITS_LOG("Evt:EVENT_ShiDuSet %d\n", currentDataPoint.valueShiDuSet);
+			LOG_INFO("Evt:EVENT_ShiDuSet %d\n", currentDataPoint.valueShiDuSet);
 			//user handle
 			localArray[6] = currentDataPoint.valueShiDuSet;
 			break;
 		case EVENT_YaChaSet:
 			currentDataPoint.valueYaChaSet = dataPointPtr->valueYaChaSet;
-			GIZWITS_LOG("Evt:EVENT_YaChaSet %d\n", currentDataPoint.valueYaChaSet);
+			LOG_INFO("Evt:EVENT_YaChaSet %d\n", currentDataPoint.valueYaChaSet);
 			//user handle
 			break;
 
@@ -131,29 +159,30 @@ int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *gizdata, uint32_t len)
 
 			break;
 		case WIFI_CON_M2M:
-
+			LOG_INFO("M2M connected, %d queued reports to send\n", backlogCount());
 			break;
 		case WIFI_DISCON_M2M:
+			LOG_WARN("M2M disconnected, reports are queued\n");
 			break;
 		case WIFI_RSSI:
-			GIZWITS_LOG("RSSI %d\n", wifiData->rssi);
+			LOG_INFO("RSSI %d\n", wifiData->rssi);
 			break;
 		case TRANSPARENT_DATA:
-			GIZWITS_LOG("TRANSPARENT_DATA \n");
+			LOG_INFO("TRANSPARENT_DATA \n");
 			//user handle , Fetch data from [data] , size is [len]
 			break;
 		case WIFI_NTP:
-			GIZWITS_LOG("WIFI_NTP : [%d-%d-%d %02d:%02d:%02d][%d] \n", ptime->year, ptime->month, ptime->day, ptime->hour, ptime->minute, ptime->second, ptime->ntp);
+			LOG_INFO("WIFI_NTP : [%d-%d-%d %02d:%02d:%02d][%d] \n", ptime->year, ptime->month, ptime->day, ptime->hour, ptime->minute, ptime->second, ptime->ntp);
 			break;
 		case MODULE_INFO:
-			GIZWITS_LOG("MODULE INFO ...\n");
+			LOG_INFO("MODULE INFO ...\n");
 #if MODULE_TYPE
-			GIZWITS_LOG("GPRS MODULE ...\n");
+			LOG_INFO("GPRS MODULE ...\n");
 			//Format By gprsInfo_t
 #else
-			GIZWITS_LOG("WIF MODULE ...\n");
+			LOG_INFO("WIF MODULE ...\n");
 			//Format By moduleInfo_t
-			GIZWITS_LOG("moduleType : [%d] \n", ptModuleInfo->moduleType);
+			LOG_INFO("moduleType : [%d] \n", ptModuleInfo->moduleType);
 #endif
 			break;
 		default:
@@ -174,31 +203,30 @@ int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *gizdata, uint32_t len)
 */
 void userHandle(void)
 {
-	uint16_t temp[2];
+	uint8_t sample = (HAL_GetTick() - userFilterTick >= USER_FILTER_PERIOD_MS);
 
-	if (tempAndHumi[0]!=localArray[5]||tempAndHumi[1]!=localArray[6])
+	if (sample)
 	{
-		tempAndHumi[0] = localArray[5];
-		tempAndHumi[1] = localArray[6];
-		STMFLASH_Write(FLASH_SAVE_ADDR, (uint16_t *)tempAndHumi, 2);
-		printf("runflashwriter\n");
-		STMFLASH_Read(FLASH_SAVE_ADDR, (uint16_t *)temp, 2);
-		printf("%d,%d\n", temp[0], temp[1]);
+		userFilterTick = HAL_GetTick();
 	}
 
+	//Only marks changed setpoints dirty, settingsHandle writes them to flash once they settle
+	settingsSet(SETTINGS_KEY_WENDU_SET, localArray[5]);
+	settingsSet(SETTINGS_KEY_SHIDU_SET, localArray[6]);
+
 	currentDataPoint.valueZS_JiZuYunXing = localArray[9]&1;//Add Sensor Data Collection
 	currentDataPoint.valueZS_ZhiBanYunXing = localArray[10]&1;//Add Sensor Data Collection
 	currentDataPoint.valueZS_FuYaYunXing = (localArray[10]>>1)&1;//Add Sensor Data Collection
 	currentDataPoint.valueZS_JiZuGuZhang = localArray[11]&1;//Add Sensor Data Collection
 	currentDataPoint.valueZS_GaoXiaoZuSe = localArray[12]&1;//Add Sensor Data Collection
-	currentDataPoint.valueWenDuZhi = localArray[7];//Add Sensor Data Collection
-	currentDataPoint.valueShiDuZhi = localArray[8];//Add Sensor Data Collection
+	currentDataPoint.valueWenDuZhi = userFiltered(&userFilter[0], localArray[7], SETTINGS_KEY_FILTER_WENDU, currentDataPoint.valueWenDuZhi, sample);//Add Sensor Data Collection
+	currentDataPoint.valueShiDuZhi = userFiltered(&userFilter[1], localArray[8], SETTINGS_KEY_FILTER_SHIDU, currentDataPoint.valueShiDuZhi, sample);//Add Sensor Data Collection
 	currentDataPoint.valueWenDuSet = localArray[5];
 	currentDataPoint.valueShiDuSet = localArray[6];
 //	currentDataPoint.valueYaChaZhi = ;//Add Sensor Data Collection
-	currentDataPoint.valueLengShuiFa = localArray[13];//Add Sensor Data Collection
-	currentDataPoint.valueReShuiFa = localArray[14];//Add Sensor Data Collection
-	currentDataPoint.valueJiaShuiQi = localArray[15];//Add Sensor Data Collection
+	currentDataPoint.valueLengShuiFa = userFiltered(&userFilter[2], localArray[13], SETTINGS_KEY_FILTER_LENGSHUI, currentDataPoint.valueLengShuiFa, sample);//Add Sensor Data Collection
+	currentDataPoint.valueReShuiFa = userFiltered(&userFilter[3], localArray[14], SETTINGS_KEY_FILTER_RESHUI, currentDataPoint.valueReShuiFa, sample);//Add Sensor Data Collection
+	currentDataPoint.valueJiaShuiQi = userFiltered(&userFilter[4], localArray[15], SETTINGS_KEY_FILTER_JIASHUI, currentDataPoint.valueJiaShuiQi, sample);//Add Sensor Data Collection
 
 }
 
@@ -215,20 +243,28 @@ void userInit(void)
 	memset((uint8_t*)&currentDataPoint, 0, sizeof(dataPoint_t));
 	
 	
-	STMFLASH_Read(FLASH_SAVE_ADDR, (uint16_t *)tempAndHumi, 2);
-	printf("chushihua %d,%d\n", tempAndHumi[0], tempAndHumi[1]);
-	printf("initflashresd\n");
-	if (tempAndHumi[0]>999||tempAndHumi[1]>999)
+	STMFLASH_Read(FLASH_SAVE_ADDR, (uint16_t *)tempAndHumi, 2);	//setpoints in the old single-record layout
+	if (settingsInit())
 	{
-		tempAndHumi[0] = 250;
-		tempAndHumi[1] = 500;
-		STMFLASH_Write(FLASH_SAVE_ADDR, (uint16_t *)tempAndHumi, 2);
-		printf("initflashwriter\n");
+		//No settings store yet: carry the old setpoints over if they are sane
+		if (tempAndHumi[0]>999||tempAndHumi[1]>999)
+		{
+			tempAndHumi[0] = 250;
+			tempAndHumi[1] = 500;
+		}
+		settingsSet(SETTINGS_KEY_WENDU_SET, tempAndHumi[0]);
+		settingsSet(SETTINGS_KEY_SHIDU_SET, tempAndHumi[1]);
+		settingsCommit();
+		LOG_INFO("initflashwriter\n");
 	}
+	tempAndHumi[0] = settingsGet(SETTINGS_KEY_WENDU_SET, 250);
+	tempAndHumi[1] = settingsGet(SETTINGS_KEY_SHIDU_SET, 500);
+	LOG_INFO("chushihua %d,%d\n", tempAndHumi[0], tempAndHumi[1]);
+	LOG_INFO("initflashresd\n");
 
 	localArray[5] = tempAndHumi[0];
 	localArray[6] = tempAndHumi[1];
-	printf("%d,%d\n", tempAndHumi[0], tempAndHumi[1]);
+	LOG_INFO("%d,%d\n", tempAndHumi[0], tempAndHumi[1]);
 	
 
 	/** Warning !!! DataPoint Variables Init , Must Within The Data Range **/
@@ -290,6 +326,17 @@ void mcuRestart(void)
 	NVIC_SystemReset();
 }
 
+/**
+* @brief Drive the GPRS module reset line
+
+* @param active : 1, hold the module in reset; 0, release it
+* @return none
+*/
+void mcuModuleReset(uint8_t active)
+{
+	HAL_GPIO_WritePin(G510_RST_GPIO_Port, G510_RST_Pin, active ? GPIO_PIN_RESET : GPIO_PIN_SET);
+}
+
 /**@} */
 
 
@@ -315,21 +362,137 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 }
 
 
+static uint8_t uartTxRing[UART_TX_RING_LEN];            ///< Escaped frames waiting for the DMA
+static volatile uint32_t uartTxHead = 0;                ///< Bytes encoded into the ring so far
+static volatile uint32_t uartTxTail = 0;                ///< Bytes sent out by the DMA so far
+static volatile uint16_t uartTxBusyLen = 0;             ///< Length of the span on the wire, 0 when idle
+volatile uint32_t uartTxDropped = 0;                    ///< Frames refused because the ring was full
+
+/**
+* Start the DMA on the oldest contiguous span of the transmit ring
+* Call with interrupts disabled or from the USART2 interrupt
+* @param none
+* @return none
+*/
+static void uartTxKick(void)
+{
+	uint32_t pos = 0;
+	uint32_t span = 0;
+
+	if ((0 != uartTxBusyLen) || (uartTxHead == uartTxTail))
+	{
+		return;
+	}
+
+	pos = uartTxTail & (UART_TX_RING_LEN - 1);
+	span = uartTxHead - uartTxTail;
+	if (span > UART_TX_RING_LEN - pos)
+	{
+		span = UART_TX_RING_LEN - pos;
+	}
+
+	uartTxBusyLen = span;
+	if (HAL_OK != HAL_UART_Transmit_DMA(&huart2, &uartTxRing[pos], span))
+	{
+		uartTxBusyLen = 0;
+	}
+}
+
+volatile uint32_t uartRxOverrun = 0;                   ///< Bursts with an overrun error
+volatile uint32_t uartRxFrameError = 0;                ///< Bursts with a framing error
+volatile uint32_t uartRxNoise = 0;                     ///< Bursts with a noise error
+volatile uint32_t uartRxRingOverflow = 0;              ///< Bursts that ran over unread bytes in the receive ring
+
+/**
+* Publish the bytes DMA1 channel 6 has written into the receive ring since the last call
+* Runs from the USART2 IDLE interrupt and the DMA half and full transfer interrupts
+* @param none
+* @return none
+*/
+static void uartRxUpdate(void)
+{
+	uint32_t pos = (pRb.rbCapacity - __HAL_DMA_GET_COUNTER(&hdma_usart2_rx)) & (pRb.rbCapacity - 1);
+	uint32_t fresh = (pos - pRb.rbTail) & (pRb.rbCapacity - 1);
+
+	if (0 == fresh)
+	{
+		return;
+	}
+
+	if (fresh > rbCanWrite(&pRb))
+	{
+		uartRxRingOverflow++;
+	}
+
+	rbPublish(&pRb, fresh);
+	schedulerSignal(SCHEDULER_TASK_GIZWITS);
+}
+
+static void uartRxDmaEvent(DMA_HandleTypeDef *hdma)
+{
+	uartRxUpdate();
+}
+
 /**
 * @brief USART串口中断函数
 
 * 接收功能，用于接收与WiFi模组间的串口协议数据
+* The bytes themselves are moved by DMA, this interrupt only handles the IDLE line,
+* which also samples the receive error flags, and TC at the end of a transmission
 * @param none
 * @return none
 */
+void USART2_IRQHandler(void)
+{
+	PROFILE_SCOPE(PROFILE_ISR_USART2);
+	uint32_t isrflags = huart2.Instance->SR;
+	uint8_t Clear = Clear;
+
+	if (isrflags & USART_SR_IDLE)
+	{
+		if (isrflags & USART_SR_ORE)
+		{
+			uartRxOverrun++;
+		}
+		if (isrflags & USART_SR_FE)
+		{
+			uartRxFrameError++;
+		}
+		if (isrflags & USART_SR_NE)
+		{
+			uartRxNoise++;
+		}
+		if (0 == (isrflags & USART_SR_RXNE))
+		{
+			Clear = huart2.Instance->DR;		//Ends the SR/DR sequence that clears the flags, never steals a byte from the DMA
+		}
 
-uint8_t RxData = 0;
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *UartHandle)
+		uartRxUpdate();
+	}
+
+	HAL_UART_IRQHandler(&huart2);			//TC at the end of a DMA transmission
+}
+
+/**
+* Transmit complete callback, the DMA transmission of a UART has finished
+* @param UartHandle : UART handle
+* @return none
+*/
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *UartHandle)
 {
-	if (UartHandle->Instance == USART2)
+	if (UartHandle->Instance == USART1)
 	{
-		gizPutData(&RxData, 1);
-		HAL_UART_Receive_IT(&huart2, &RxData, 1);
+		usart1TransmitCplt();
+	}
+	else if (UartHandle->Instance == USART2)
+	{
+		uartTxTail += uartTxBusyLen;
+		uartTxBusyLen = 0;
+		uartTxKick();
+	}
+	else if (UartHandle->Instance == USART3)
+	{
+		logTxCplt();
 	}
 
 }
@@ -338,52 +501,111 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *UartHandle)
 /**
 * @brief Serial port write operation, send data to WiFi module
 *
+* The frame is escaped into the transmit ring and sent by DMA, the call returns at once
+*
 * @param buf      : buf address
 * @param len      : buf length
 *
 * @return : Return effective data length;-1，return failure
 */
 int32_t uartWrite(uint8_t *buf, uint32_t len)
+{
+	return uartWriteAsync(buf, len, NULL);
+}
+
+/**
+* @brief Queue a frame for the WiFi module without waiting for it to be sent
+*
+* Every 0xFF after the two header bytes is followed by 0x55, the same as the byte-by-byte sender did
+*
+* @param buf      : buf address
+* @param len      : buf length
+* @param handle   : filled with the position to pass to uartTxComplete, may be NULL
+*
+* @return : Return effective data length;-1，return failure
+*/
+int32_t uartWriteAsync(uint8_t *buf, uint32_t len, uartTxHandle_t *handle)
 {
 	uint32_t i = 0;
-	uint8_t data55[1] = { 0x55 };
+	uint32_t escLen = len;
+	uint32_t head = 0;
+	uint32_t primask = 0;
+	PROFILE_SCOPE(PROFILE_UART_WRITE);				//uartWrite and the resend path both end up here
 
 	if (NULL == buf)
 	{
 		return -1;
 	}
 #ifdef PROTOCOL_DEBUG
-	GIZWITS_LOG("MCU2WiFi[%4d:%4d]: ", gizGetTimerCount(), len);
+	LOG_DEBUG("MCU2WiFi[%4d:%4d]: ", gizGetTimerCount(), len);
 	for (i = 0; i<len; i++)
 	{
-		GIZWITS_LOG("%02x ", buf[i]);
+		LOG_DEBUG("%02x ", buf[i]);
 
 		if (i >= 2 && buf[i] == 0xFF)
 		{
-			GIZWITS_LOG("%02x ", 0x55);
+			LOG_DEBUG("%02x ", 0x55);
 		}
 	}
 
-	GIZWITS_LOG("\n");
+	LOG_DEBUG("\n");
 #endif
 
+	for (i = 2; i<len; i++)
+	{
+		if (buf[i] == 0xFF)
+		{
+			escLen++;
+		}
+	}
+
+	if (escLen > UART_TX_RING_LEN - (uartTxHead - uartTxTail))
+	{
+		uartTxDropped++;
+		return -1;
+	}
+
+	head = uartTxHead;
 	for (i = 0; i<len; i++)
 	{
-		HAL_UART_Transmit(&huart2, &buf[i], 1, 1000);
-		while (__HAL_UART_GET_FLAG(&huart2, UART_FLAG_TXE) == RESET);//Loop until the end of transmission
+		uartTxRing[head++ & (UART_TX_RING_LEN - 1)] = buf[i];
 
 		if (i >= 2 && buf[i] == 0xFF)
 		{
-			HAL_UART_Transmit(&huart2, data55, 1, 1000);
-			while (__HAL_UART_GET_FLAG(&huart2, UART_FLAG_TXE) == RESET);//Loop until the end of transmission
+			uartTxRing[head++ & (UART_TX_RING_LEN - 1)] = 0x55;
 		}
 	}
 
+	primask = __get_PRIMASK();
+	__disable_irq();
+	uartTxHead = head;
+	uartTxKick();
+	__set_PRIMASK(primask);
+
+	if (NULL != handle)
+	{
+		*handle = head;
+	}
+
 	return len;
 }
 
+/**
+* @brief Check whether a queued frame has completely left the serial port
+* @param handle   : position returned by uartWriteAsync
+* @return : 1, sent; 0, still queued or on the wire
+*/
+uint8_t uartTxComplete(uartTxHandle_t handle)
+{
+	return ((int32_t)(uartTxTail - handle) >= 0) ? 1 : 0;
+}
+
 void uartInit() {
-	HAL_UART_Receive_IT(&huart2, &RxData, 1);
+	//Circular DMA straight into the protocol ring, call after gizwitsInit has created it
+	hdma_usart2_rx.XferHalfCpltCallback = uartRxDmaEvent;
+	hdma_usart2_rx.XferCpltCallback = uartRxDmaEvent;
+	HAL_DMA_Start_IT(&hdma_usart2_rx, (uint32_t)(uintptr_t)&huart2.Instance->DR, (uint32_t)(uintptr_t)pRb.rbBuff, pRb.rbCapacity);
+	SET_BIT(huart2.Instance->CR3, USART_CR3_DMAR);
 }
 
 void timerInit() {
@@ -36,18 +36,32 @@ extern "C" {
 */
 #define MODULE_TYPE 1 //0,WIFI ;1,GPRS
 
+/**
+* Serial port transmit ring length, must be a power of two
+*/
+#define UART_TX_RING_LEN 512
+
+typedef uint32_t uartTxHandle_t;                    ///< Transmit stream position just past a queued frame
+
 
-uint16_t localArray[];
+extern uint16_t localArray[];
 
 
 extern dataPoint_t currentDataPoint;
+extern volatile uint32_t uartRxOverrun;
+extern volatile uint32_t uartRxFrameError;
+extern volatile uint32_t uartRxNoise;
+extern volatile uint32_t uartRxRingOverflow;
 
 void uartInit(); //串口初始化
 void timerInit();//定时器初始化
 void userInit(void);
 void userHandle(void);
 void mcuRestart(void);
+void mcuModuleReset(uint8_t active);
 int32_t uartWrite(uint8_t *buf, uint32_t len);
+int32_t uartWriteAsync(uint8_t *buf, uint32_t len, uartTxHandle_t *handle);
+uint8_t uartTxComplete(uartTxHandle_t handle);
 int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *data, uint32_t len);
 
 #ifdef __cplusplus
@@ -13,12 +13,18 @@
 *               www.gizwits.com
 *
 ***********************************************************/
+#define LOG_MODULE LOG_MODULE_PROTOCOL
 #include "ringBuffer.h"
 #include "gizwits_product.h"
 #include "dataPointTools.h"
+#include "profile.h"
+#include "settings.h"
+#include "backlog.h"
+#include <stddef.h>
 
 /** Protocol global variables **/
 gizwitsProtocol_t gizwitsProtocol;
+static uint8_t gizCompactDeltas = REPORT_KEYFRAME_NUM;  ///< compact reports since the last keyframe, see gizStatusReport
 
 
 /**@name The serial port receives the ring buffer implementation
@@ -26,6 +32,7 @@ gizwitsProtocol_t gizwitsProtocol;
 */
 rb_t pRb;                                               ///< Ring buffer structure variable 循环缓冲区结构变量
 static uint8_t rbBuf[RB_MAX_LEN];                       ///< Ring buffer data cache buffer  环缓冲数据缓存缓冲区
+typedef char rbMaxLenCheck_t[(RB_MAX_LEN >= 2 * MAX_PACKAGE_LEN) ? 1 : -1];   ///< Fails to compile when the ring can no longer hold two packets
 
 
 /**@} */
@@ -43,14 +50,14 @@ int32_t gizPutData(uint8_t *buf, uint32_t len)
 
 	if (NULL == buf)
 	{
-		GIZWITS_LOG("ERR: gizPutData buf is empty \n");
+		LOG_ERROR("ERR: gizPutData buf is empty \n");
 		return -1;
 	}
 
 	count = rbWrite(&pRb, buf, len);
 	if (count != len)
 	{
-		GIZWITS_LOG("ERR: Failed to rbWrite \n");
+		LOG_ERROR("ERR: Failed to rbWrite \n");
 		return -1;
 	}
 
@@ -70,7 +77,7 @@ static int8_t gizProtocolHeadInit(protocolHead_t *head)
 {
 	if (NULL == head)
 	{
-		GIZWITS_LOG("ERR: gizProtocolHeadInit head is empty \n");
+		LOG_ERROR("ERR: gizProtocolHeadInit head is empty \n");
 		return -1;
 	}
 
@@ -82,227 +89,430 @@ static int8_t gizProtocolHeadInit(protocolHead_t *head)
 }
 
 /**
-* @brief Protocol ACK check processing function 协议ACK检查处理功能
-*
-* @param [in] data            : data adress
-* @param [in] len             : data length
+* @brief Fold an ACK round trip into the resend timeout	往返时间估计
+
+* RFC 6298: SRTT and RTTVAR are moving averages with gains 1/8 and 1/4, and
+* RTO = SRTT + 4 * RTTVAR, kept within RTO_MIN..RTO_MAX. Only messages that were
+* never resent give a sample, an ACK of a resent one could belong to either copy.
+
+* @param [in] rtt : milliseconds from the send to the ACK
 *
-* @return 0， suceess; other， failure
+* @return none
 */
-static int8_t gizProtocolWaitAck(uint8_t *gizdata, uint32_t len)
+static void gizProtocolRttSample(uint32_t rtt)
 {
-	if (NULL == gizdata)
+	protocolRtt_t *est = &gizwitsProtocol.rtt;
+	uint32_t delta;
+
+	if (0 == est->samples)
 	{
-		GIZWITS_LOG("ERR: data is empty \n");
-		return -1;
+		est->srtt = rtt;
+		est->rttvar = rtt / 2;
 	}
+	else
+	{
+		delta = (est->srtt > rtt) ? (est->srtt - rtt) : (rtt - est->srtt);
+		est->rttvar = (3 * est->rttvar + delta) / 4;
+		est->srtt = (7 * est->srtt + rtt) / 8;
+	}
+	est->samples++;
 
-	memset((uint8_t *)&gizwitsProtocol.waitAck, 0, sizeof(protocolWaitAck_t));
-	memcpy((uint8_t *)gizwitsProtocol.waitAck.buf, gizdata, len);
-	gizwitsProtocol.waitAck.dataLen = (uint16_t)len;
-
-	gizwitsProtocol.waitAck.flag = 1;
-	gizwitsProtocol.waitAck.sendTime = gizGetTimerCount();
-
-	return 0;
+	est->rto = est->srtt + 4 * est->rttvar;
+	if (RTO_MIN > est->rto)
+	{
+		est->rto = RTO_MIN;
+	}
+	else if (RTO_MAX < est->rto)
+	{
+		est->rto = RTO_MAX;
+	}
 }
+
 /**
-* @brief generates "controlled events" according to protocol 根据协议生成“受控事件”
+* @brief Resend timeout of a copy	重发超时
 
-* @param [in] issuedData: Controlled data			受控数据
-* @param [out] info: event queue					事件队列
-* @param [out] dataPoints: data point data			数据点数据
-* @return 0, the implementation of success, non-0, failed
+* RTO doubled for every resend so far, capped at RTO_MAX, plus up to a quarter more at
+* random so that retries do not line up with whatever else is queued at the module
+
+* @param [in] num : resends so far
+*
+* @return timeout in milliseconds
 */
-static int8_t ICACHE_FLASH_ATTR gizDataPoint2Event(gizwitsIssued_t *issuedData, eventInfo_t *info, dataPoint_t *dataPoints)
+static uint32_t gizProtocolResendTimeout(uint8_t num)
 {
-	if ((NULL == issuedData) || (NULL == info) || (NULL == dataPoints))
-	{
-		GIZWITS_LOG("gizDataPoint2Event Error , Illegal Param\n");
-		return -1;
-	}
+	protocolRtt_t *est = &gizwitsProtocol.rtt;
+	uint32_t timeout = est->rto;
 
-	/** Greater than 1 byte to do bit conversion **/
-	if (sizeof(issuedData->attrFlags) > 1)
+	while ((0 < num--) && (RTO_MAX > timeout))
 	{
-		if (-1 == gizByteOrderExchange((uint8_t *)&issuedData->attrFlags, sizeof(attrFlags_t)))
-		{
-			GIZWITS_LOG("gizByteOrderExchange Error\n");
-			return -1;
-		}
+		timeout <<= 1;
 	}
-
-	if (0x01 == issuedData->attrFlags.flagSW_KongTiao)
+	if (RTO_MAX < timeout)
 	{
-		info->event[info->num] = EVENT_SW_KongTiao;
-		info->num++;
-		dataPoints->valueSW_KongTiao = gizStandardDecompressionValue(SW_KongTiao_BYTEOFFSET, SW_KongTiao_BITOFFSET, SW_KongTiao_LEN, (uint8_t *)&issuedData->attrVals.wBitBuf, sizeof(issuedData->attrVals.wBitBuf));
+		timeout = RTO_MAX;
 	}
 
-	if (0x01 == issuedData->attrFlags.flagSW_ZhiBan)
+	est->seed ^= gizGetTimerCount();
+	est->seed ^= est->seed << 13;
+	est->seed ^= est->seed >> 17;
+	est->seed ^= est->seed << 5;
+	if (0 == est->seed)
 	{
-		info->event[info->num] = EVENT_SW_ZhiBan;
-		info->num++;
-		dataPoints->valueSW_ZhiBan = gizStandardDecompressionValue(SW_ZhiBan_BYTEOFFSET, SW_ZhiBan_BITOFFSET, SW_ZhiBan_LEN, (uint8_t *)&issuedData->attrVals.wBitBuf, sizeof(issuedData->attrVals.wBitBuf));
+		est->seed = 0x2545F491;
 	}
+	return timeout + est->seed % ((timeout >> RTO_JITTER_SHIFT) + 1);
+}
 
-	if (0x01 == issuedData->attrFlags.flagSW_FuYa)
+/**
+* @brief Give up an ACK window entry	放弃等待ACK
+*
+* A status report sent live goes back to the backlog, to be sent again before
+* anything queued; one sent from the backlog is still there. Either way the
+* receiver may have missed a compact frame, so the next one is a keyframe.
+*
+* @param [in] waitAck : ACK window entry
+*
+* @return none
+*/
+static void gizProtocolWaitAckDrop(protocolWaitAck_t *waitAck)
+{
+	if (1 != waitAck->flag)
 	{
-		info->event[info->num] = EVENT_SW_FuYa;
-		info->num++;
-		dataPoints->valueSW_FuYa = gizStandardDecompressionValue(SW_FuYa_BYTEOFFSET, SW_FuYa_BITOFFSET, SW_FuYa_LEN, (uint8_t *)&issuedData->attrVals.wBitBuf, sizeof(issuedData->attrVals.wBitBuf));
+		return;
 	}
+	LOG_WARN("Warning: sn %d given up without an ACK \n", waitAck->sn);
+	gizwitsProtocol.link.dropped++;
 
-
-	if (0x01 == issuedData->attrFlags.flagWenDuSet)
+	if (ACK_REPORT_LIVE == waitAck->reportSource)
 	{
-		info->event[info->num] = EVENT_WenDuSet;
-		info->num++;
-		dataPoints->valueWenDuSet = gizX2Y(WenDuSet_RATIO, WenDuSet_ADDITION, exchangeBytes(issuedData->attrVals.valueWenDuSet));
+		backlogRequeue(waitAck->reportTime, &waitAck->reportStatus);
 	}
-
-	if (0x01 == issuedData->attrFlags.flagShiDuSet)
+	if (ACK_REPORT_NONE != waitAck->reportSource)
 	{
-		info->event[info->num] = EVENT_ShiDuSet;
-		info->num++;
-		dataPoints->valueShiDuSet = gizX2Y(ShiDuSet_RATIO, ShiDuSet_ADDITION, exchangeBytes(issuedData->attrVals.valueShiDuSet));
+		gizCompactDeltas = REPORT_KEYFRAME_NUM;
 	}
-
-	if (0x01 == issuedData->attrFlags.flagYaChaSet)
-	{
-		info->event[info->num] = EVENT_YaChaSet;
-		info->num++;
-		dataPoints->valueYaChaSet = gizX2Y(YaChaSet_RATIO, YaChaSet_ADDITION, exchangeBytes(issuedData->attrVals.valueYaChaSet));
-	}
-
-	return 0;
+	memset((uint8_t *)waitAck, 0, sizeof(protocolWaitAck_t));
 }
 
 /**
-* @brief contrasts the current data with the last data		将当前数据与最后的数据进行对比
+* @brief Protocol ACK check processing function 协议ACK检查处理功能
 *
-* @param [in] cur: current data point data					当前数据点数据
-* @param [in] last: last data point data					最后一个数据点的数据
+* The message takes a free slot of the ACK window, so several messages can be
+* outstanding at once. With the window full the oldest message is given up, see
+* gizProtocolWaitAckDrop.
 *
-* @return: 0, no change in data; 1, data changes
+* @param [in] data            : data adress
+* @param [in] len             : data length
+* @param [in] txHandle        : uartWriteAsync handle of the first copy, so no resend stacks behind it
+*
+* @return 0， suceess; other， failure
 */
-static int8_t ICACHE_FLASH_ATTR gizCheckReport(dataPoint_t *cur, dataPoint_t *last)
+static int8_t gizProtocolWaitAck(uint8_t *gizdata, uint32_t len, uartTxHandle_t txHandle)
 {
-	int8_t ret = 0;
-	static uint32_t lastReportTime = 0;
+	protocolWaitAck_t *waitAck = NULL;
+	uint8_t i;
 
-	if ((NULL == cur) || (NULL == last))
+	if (NULL == gizdata)
 	{
-		GIZWITS_LOG("gizCheckReport Error , Illegal Param\n");
+		LOG_ERROR("ERR: data is empty \n");
 		return -1;
 	}
-	if (last->valueSW_KongTiao != cur->valueSW_KongTiao)
-	{
-		GIZWITS_LOG("valueSW_KongTiao Changed\n");
-		ret = 1;
-	}
-	if (last->valueSW_ZhiBan != cur->valueSW_ZhiBan)
+	if (MAX_PACKAGE_LEN < len)
 	{
-		GIZWITS_LOG("valueSW_ZhiBan Changed\n");
-		ret = 1;
-	}
-	if (last->valueSW_FuYa != cur->valueSW_FuYa)
-	{
-		GIZWITS_LOG("valueSW_FuYa Changed\n");
-		ret = 1;
+		LOG_ERROR("ERR: %d bytes do not fit the resend buffer \n", len);
+		return -1;
 	}
-	if (last->valueWenDuSet != cur->valueWenDuSet)
+
+	for (i = 0; i < ACK_WINDOW_SIZE; i++)
 	{
-		GIZWITS_LOG("valueWenDuSet Changed\n");
-		ret = 1;
+		if (0 == gizwitsProtocol.waitAck[i].flag)
+		{
+			waitAck = &gizwitsProtocol.waitAck[i];
+			break;
+		}
+		if ((NULL == waitAck) || ((int32_t)(gizwitsProtocol.waitAck[i].sendTime - waitAck->sendTime) < 0))
+		{
+			waitAck = &gizwitsProtocol.waitAck[i];
+		}
 	}
-	if (last->valueShiDuSet != cur->valueShiDuSet)
+	gizProtocolWaitAckDrop(waitAck);
+
+	memset((uint8_t *)waitAck, 0, sizeof(protocolWaitAck_t));
+	memcpy((uint8_t *)waitAck->buf, gizdata, len);
+	waitAck->dataLen = (uint16_t)len;
+	waitAck->cmd = ((protocolHead_t *)gizdata)->cmd;
+	waitAck->sn = ((protocolHead_t *)gizdata)->sn;
+	waitAck->txHandle = txHandle;
+
+	waitAck->flag = 1;
+	waitAck->sendTime = gizGetTimerCount();
+	waitAck->timeout = gizProtocolResendTimeout(0);
+
+	return 0;
+}
+
+/* Record in the ACK window entry of the status report just sent which status it carries and where from */
+static void gizProtocolWaitAckReport(uint8_t source, uint32_t time, const devStatus_t *status)
+{
+	uint8_t sn = (uint8_t)(gizwitsProtocol.sn - 1);
+	uint8_t i;
+
+	for (i = 0; i < ACK_WINDOW_SIZE; i++)
 	{
-		GIZWITS_LOG("valueShiDuSet Changed\n");
-		ret = 1;
+		if ((1 == gizwitsProtocol.waitAck[i].flag) && (CMD_REPORT_P0 == gizwitsProtocol.waitAck[i].cmd) &&
+			(sn == gizwitsProtocol.waitAck[i].sn))
+		{
+			gizwitsProtocol.waitAck[i].reportSource = source;
+			gizwitsProtocol.waitAck[i].reportTime = time;
+			memcpy((uint8_t *)&gizwitsProtocol.waitAck[i].reportStatus, (const uint8_t *)status, sizeof(devStatus_t));
+			return;
+		}
 	}
-	if (last->valueYaChaSet != cur->valueYaChaSet)
+}
+
+/**@name Data point descriptors, in P0 order. Adding a data point is one line here
+* (plus its fields in the dataPoint_t/devStatus_t/attrVals_t structures)
+* @{	数据点描述表
+*/
+#define GIZ_DP_BOOL_W(name, flag, policy)   { "value" #name, GIZ_DP_BOOL, offsetof(dataPoint_t, value##name), sizeof(((dataPoint_t *)0)->value##name), \
+                                              name##_BYTEOFFSET, name##_BITOFFSET, name##_LEN, flag, 0, EVENT_##name, policy, 1, 0, 0, 1 }
+#define GIZ_DP_BOOL_R(name, policy)         { "value" #name, GIZ_DP_BOOL, offsetof(dataPoint_t, value##name), sizeof(((dataPoint_t *)0)->value##name), \
+                                              name##_BYTEOFFSET, name##_BITOFFSET, name##_LEN, GIZ_DP_READ_ONLY, 0, EVENT_TYPE_MAX, policy, 1, 0, 0, 1 }
+#define GIZ_DP_VALUE_W(name, flag, policy)  { "value" #name, GIZ_DP_VALUE, offsetof(dataPoint_t, value##name), sizeof(((dataPoint_t *)0)->value##name), \
+                                              offsetof(devStatus_t, value##name), 0, 0, flag, offsetof(attrVals_t, value##name), EVENT_##name, policy, \
+                                              name##_RATIO, name##_ADDITION, name##_MIN, name##_MAX }
+#define GIZ_DP_VALUE_R(name, policy)        { "value" #name, GIZ_DP_VALUE, offsetof(dataPoint_t, value##name), sizeof(((dataPoint_t *)0)->value##name), \
+                                              offsetof(devStatus_t, value##name), 0, 0, GIZ_DP_READ_ONLY, 0, EVENT_TYPE_MAX, policy, \
+                                              name##_RATIO, name##_ADDITION, name##_MIN, name##_MAX }
+
+static const gizDataPoint_t gizDataPoints[] =
+{
+	GIZ_DP_BOOL_W(SW_KongTiao, 0, GIZ_REPORT_CHANGE),
+	GIZ_DP_BOOL_W(SW_ZhiBan, 1, GIZ_REPORT_CHANGE),
+	GIZ_DP_BOOL_W(SW_FuYa, 2, GIZ_REPORT_CHANGE),
+	GIZ_DP_VALUE_W(WenDuSet, 3, GIZ_REPORT_CHANGE),
+	GIZ_DP_VALUE_W(ShiDuSet, 4, GIZ_REPORT_CHANGE),
+	GIZ_DP_VALUE_W(YaChaSet, 5, GIZ_REPORT_CHANGE),
+	GIZ_DP_BOOL_R(ZS_JiZuYunXing, GIZ_REPORT_CHANGE),
+	GIZ_DP_BOOL_R(ZS_ZhiBanYunXing, GIZ_REPORT_CHANGE),
+	GIZ_DP_BOOL_R(ZS_FuYaYunXing, GIZ_REPORT_CHANGE),
+	GIZ_DP_BOOL_R(ZS_JiZuGuZhang, GIZ_REPORT_CHANGE),
+	GIZ_DP_BOOL_R(ZS_GaoXiaoZuSe, GIZ_REPORT_CHANGE),
+	GIZ_DP_VALUE_R(WenDuZhi, GIZ_REPORT_ANALOG(5, SETTINGS_KEY_DEADBAND_WENDU)),        //0.5 degC
+	GIZ_DP_VALUE_R(ShiDuZhi, GIZ_REPORT_ANALOG(10, SETTINGS_KEY_DEADBAND_SHIDU)),       //1 %RH
+	GIZ_DP_VALUE_R(YaChaZhi, GIZ_REPORT_ANALOG(5, SETTINGS_KEY_NONE)),
+	GIZ_DP_VALUE_R(LengShuiFa, GIZ_REPORT_ANALOG(10, SETTINGS_KEY_DEADBAND_LENGSHUI)),
+	GIZ_DP_VALUE_R(ReShuiFa, GIZ_REPORT_ANALOG(10, SETTINGS_KEY_DEADBAND_RESHUI)),
+	GIZ_DP_VALUE_R(JiaShuiQi, GIZ_REPORT_ANALOG(10, SETTINGS_KEY_DEADBAND_JIASHUI)),
+};
+
+#define GIZ_DATAPOINT_COUNT (sizeof(gizDataPoints) / sizeof(gizDataPoints[0]))
+typedef char gizDataPointCountCheck_t[(GIZ_DATAPOINT_COUNT <= 32) ? 1 : -1];   ///< Change masks are 32 bits
+
+/** Fields are at most 4 bytes; both targets are little-endian */
+static uint32_t gizDataPointGet(const dataPoint_t *dataPoints, const gizDataPoint_t *dp)
+{
+	uint32_t value = 0;
+
+	memcpy(&value, (const uint8_t *)dataPoints + dp->point, dp->width);
+	return value;
+}
+
+static void gizDataPointSet(dataPoint_t *dataPoints, const gizDataPoint_t *dp, uint32_t value)
+{
+	memcpy((uint8_t *)dataPoints + dp->point, &value, dp->width);
+}
+
+/** Bit i set for every gizDataPoints[i] that differs between the two */
+static uint32_t gizDataPointsChanged(const dataPoint_t *cur, const dataPoint_t *last)
+{
+	uint32_t changed = 0;
+	uint8_t i;
+
+	if (0 == memcmp(cur, last, sizeof(dataPoint_t)))
 	{
-		GIZWITS_LOG("valueYaChaSet Changed\n");
-		ret = 1;
+		return 0;
 	}
-	if (last->valueZS_JiZuYunXing != cur->valueZS_JiZuYunXing)
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
 	{
-		GIZWITS_LOG("valueZS_JiZuYunXing Changed\n");
-		ret = 1;
+		if (0 != memcmp((const uint8_t *)cur + gizDataPoints[i].point, (const uint8_t *)last + gizDataPoints[i].point, gizDataPoints[i].width))
+		{
+			changed |= 1UL << i;
+		}
 	}
-	if (last->valueZS_ZhiBanYunXing != cur->valueZS_ZhiBanYunXing)
+	return changed;
+}
+
+/**
+* Deadband in force for a data point: its settings key if set, else the table
+* value. GIZ_DEADBAND_PERCENT makes it relative to the magnitude of the last
+* reported value y = ratio * x + addition, never less than one step of x, so a
+* value near zero does not report every LSB of noise.
+*/
+static uint32_t gizDataPointDeadband(const gizDataPoint_t *dp, uint32_t lastValue)
+{
+	uint16_t deadband = dp->deadband;
+	uint32_t magnitude = ((int32_t)lastValue < 0) ? -(int32_t)lastValue : lastValue;
+	uint32_t relative;
+
+	if (SETTINGS_KEY_NONE != dp->deadbandKey)
 	{
-		GIZWITS_LOG("valueZS_ZhiBanYunXing Changed\n");
-		ret = 1;
+		deadband = settingsGet(dp->deadbandKey, GIZ_DEADBAND_DEFAULT);
+		if (GIZ_DEADBAND_DEFAULT == deadband)
+		{
+			deadband = dp->deadband;
+		}
 	}
-	if (last->valueZS_FuYaYunXing != cur->valueZS_FuYaYunXing)
+	if (deadband & GIZ_DEADBAND_PERCENT)
 	{
-		GIZWITS_LOG("valueZS_FuYaYunXing Changed\n");
-		ret = 1;
+		relative = (magnitude * (deadband & ~GIZ_DEADBAND_PERCENT) + 500) / 1000;
+		return (relative < dp->ratio) ? dp->ratio : relative;
 	}
-	if (last->valueZS_JiZuGuZhang != cur->valueZS_JiZuGuZhang)
+	return deadband;
+}
+
+static uint32_t gizReportTime[GIZ_DATAPOINT_COUNT];   ///< When each data point last triggered a report, for minInterval
+static uint32_t gizSentTime[GIZ_DATAPOINT_COUNT];     ///< When the cloud last got a new value of it, for maxStale
+
+/**
+* Restart the timers before a report goes out. Fields that merely ride along
+* with another field's report only restart their staleness timer, so a noisy
+* field cannot hold back a real change of a quiet one.
+*/
+static void gizDataPointsReported(const dataPoint_t *cur, const dataPoint_t *last, uint32_t due)
+{
+	uint32_t changed = gizDataPointsChanged(cur, last);
+	uint32_t timeNow = gizGetTimerCount();
+	uint8_t i;
+
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
 	{
-		GIZWITS_LOG("valueZS_JiZuGuZhang Changed\n");
-		ret = 1;
+		if (due & (1UL << i))
+		{
+			gizReportTime[i] = timeNow;
+		}
+		if (changed & (1UL << i))
+		{
+			gizSentTime[i] = timeNow;
+		}
 	}
-	if (last->valueZS_GaoXiaoZuSe != cur->valueZS_GaoXiaoZuSe)
+}
+/**@} */
+
+/**
+* @brief generates "controlled events" according to protocol 根据协议生成“受控事件”
+
+* @param [in] issuedData: Controlled data			受控数据
+* @param [out] info: event queue					事件队列
+* @param [out] dataPoints: data point data			数据点数据
+* @return 0, the implementation of success, non-0, failed
+*/
+static int8_t ICACHE_FLASH_ATTR gizDataPoint2Event(gizwitsIssued_t *issuedData, eventInfo_t *info, dataPoint_t *dataPoints)
+{
+	const gizDataPoint_t *dp;
+	uint8_t *flags = (uint8_t *)&issuedData->attrFlags;
+	uint16_t raw;
+	uint32_t value;
+	uint8_t i;
+
+	if ((NULL == issuedData) || (NULL == info) || (NULL == dataPoints))
 	{
-		GIZWITS_LOG("valueZS_GaoXiaoZuSe Changed\n");
-		ret = 1;
+		LOG_ERROR("gizDataPoint2Event Error , Illegal Param\n");
+		return -1;
 	}
 
-	if (last->valueWenDuZhi != cur->valueWenDuZhi)
+	/** Greater than 1 byte to do bit conversion **/
+	if (sizeof(issuedData->attrFlags) > 1)
 	{
-		if (gizGetTimerCount() - lastReportTime >= REPORT_TIME_MAX)
+		if (-1 == gizByteOrderExchange((uint8_t *)&issuedData->attrFlags, sizeof(attrFlags_t)))
 		{
-			GIZWITS_LOG("valueWenDuZhi Changed\n");
-			lastReportTime = gizGetTimerCount();
-			ret = 1;
+			LOG_ERROR("gizByteOrderExchange Error\n");
+			return -1;
 		}
 	}
-	if (last->valueShiDuZhi != cur->valueShiDuZhi)
+
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
 	{
-		if (gizGetTimerCount() - lastReportTime >= REPORT_TIME_MAX)
+		dp = &gizDataPoints[i];
+		if ((GIZ_DP_READ_ONLY == dp->flag) || (0 == ((flags[dp->flag >> 3] >> (dp->flag & 7)) & 0x01)))
 		{
-			GIZWITS_LOG("valueShiDuZhi Changed\n");
-			lastReportTime = gizGetTimerCount();
-			ret = 1;
+			continue;
 		}
-	}
-	if (last->valueYaChaZhi != cur->valueYaChaZhi)
-	{
-		if (gizGetTimerCount() - lastReportTime >= REPORT_TIME_MAX)
+
+		info->event[info->num] = dp->event;
+		info->num++;
+		if (GIZ_DP_BOOL == dp->type)
 		{
-			GIZWITS_LOG("valueYaChaZhi Changed\n");
-			lastReportTime = gizGetTimerCount();
-			ret = 1;
+			//writable bits sit in wBitBuf, which starts both attrVals_t and devStatus_t
+			value = gizStandardDecompressionValue(dp->status, dp->bitOffset, dp->bitLen, (uint8_t *)&issuedData->attrVals.wBitBuf, sizeof(issuedData->attrVals.wBitBuf));
 		}
-	}
-	if (last->valueLengShuiFa != cur->valueLengShuiFa)
-	{
-		if (gizGetTimerCount() - lastReportTime >= REPORT_TIME_MAX)
+		else
 		{
-			GIZWITS_LOG("valueLengShuiFa Changed\n");
-			lastReportTime = gizGetTimerCount();
-			ret = 1;
+			memcpy(&raw, (uint8_t *)&issuedData->attrVals + dp->issued, sizeof(raw));
+			value = gizX2Y(dp->ratio, dp->addition, exchangeBytes(raw));
+			if ((int32_t)value < dp->min)
+			{
+				value = dp->min;
+			}
+			else if ((int32_t)value > dp->max)
+			{
+				value = dp->max;
+			}
 		}
+		gizDataPointSet(dataPoints, dp, value);
 	}
-	if (last->valueReShuiFa != cur->valueReShuiFa)
+
+	return 0;
+}
+
+/**
+* @brief contrasts the current data with the last data		将当前数据与最后的数据进行对比
+*
+* @param [in] cur: current data point data					当前数据点数据
+* @param [in] last: last data point data					最后一个数据点的数据
+*
+* A changed field is due once it moved by its deadband and its minimum interval
+* has passed since it was last reported, or once it is older than its maximum
+* staleness. Each field has its own timers, see gizDataPointsReported.
+*
+* @param [out] due: bit i set for every gizDataPoints[i] that is due
+* @return: 0, nothing due; 1, at least one field due
+*/
+static int8_t ICACHE_FLASH_ATTR gizCheckReport(dataPoint_t *cur, dataPoint_t *last, uint32_t *due)
+{
+	uint32_t timeNow = gizGetTimerCount();
+	const gizDataPoint_t *dp;
+	uint32_t changed;
+	uint32_t curValue;
+	uint32_t lastValue;
+	uint32_t delta;
+	uint8_t i;
+	int8_t ret = 0;
+
+	if ((NULL == cur) || (NULL == last) || (NULL == due))
 	{
-		if (gizGetTimerCount() - lastReportTime >= REPORT_TIME_MAX)
-		{
-			GIZWITS_LOG("valueReShuiFa Changed\n");
-			lastReportTime = gizGetTimerCount();
-			ret = 1;
-		}
+		LOG_ERROR("gizCheckReport Error , Illegal Param\n");
+		return -1;
 	}
-	if (last->valueJiaShuiQi != cur->valueJiaShuiQi)
+
+	*due = 0;
+	changed = gizDataPointsChanged(cur, last);
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
 	{
-		if (gizGetTimerCount() - lastReportTime >= REPORT_TIME_MAX)
+		if (0 == (changed & (1UL << i)))
 		{
-			GIZWITS_LOG("valueJiaShuiQi Changed\n");
-			lastReportTime = gizGetTimerCount();
+			continue;
+		}
+		dp = &gizDataPoints[i];
+		curValue = gizDataPointGet(cur, dp);
+		lastValue = gizDataPointGet(last, dp);
+		delta = (curValue > lastValue) ? curValue - lastValue : lastValue - curValue;
+
+		if (((delta >= gizDataPointDeadband(dp, lastValue)) && (timeNow - gizReportTime[i] >= dp->minInterval)) ||
+			((0 != dp->maxStale) && (timeNow - gizSentTime[i] >= dp->maxStale)))
+		{
+			LOG_DEBUG("%s Changed\n", dp->name);
+			*due |= 1UL << i;
 			ret = 1;
 		}
 	}
@@ -321,38 +531,40 @@ static int8_t ICACHE_FLASH_ATTR gizCheckReport(dataPoint_t *cur, dataPoint_t *la
 */
 static int8_t ICACHE_FLASH_ATTR gizDataPoints2ReportData(dataPoint_t *dataPoints, devStatus_t *devStatusPtr)
 {
+	const gizDataPoint_t *dp;
+	uint16_t raw;
+	uint8_t i;
+	PROFILE_SCOPE(PROFILE_GIZ_REPORT_DATA);
+
 	if ((NULL == dataPoints) || (NULL == devStatusPtr))
 	{
-		GIZWITS_LOG("gizDataPoints2ReportData Error , Illegal Param\n");
+		LOG_ERROR("gizDataPoints2ReportData Error , Illegal Param\n");
 		return -1;
 	}
 
 	gizMemset((uint8_t *)devStatusPtr->wBitBuf, 0, sizeof(devStatusPtr->wBitBuf));
 	gizMemset((uint8_t *)devStatusPtr->rBitBuf, 0, sizeof(devStatusPtr->rBitBuf));
 
-	gizStandardCompressValue(SW_KongTiao_BYTEOFFSET, SW_KongTiao_BITOFFSET, SW_KongTiao_LEN, (uint8_t *)devStatusPtr, dataPoints->valueSW_KongTiao);
-	gizStandardCompressValue(SW_ZhiBan_BYTEOFFSET, SW_ZhiBan_BITOFFSET, SW_ZhiBan_LEN, (uint8_t *)devStatusPtr, dataPoints->valueSW_ZhiBan);
-	gizStandardCompressValue(SW_FuYa_BYTEOFFSET, SW_FuYa_BITOFFSET, SW_FuYa_LEN, (uint8_t *)devStatusPtr, dataPoints->valueSW_FuYa);
-	gizStandardCompressValue(ZS_JiZuYunXing_BYTEOFFSET, ZS_JiZuYunXing_BITOFFSET, ZS_JiZuYunXing_LEN, (uint8_t *)devStatusPtr, dataPoints->valueZS_JiZuYunXing);
-	gizStandardCompressValue(ZS_ZhiBanYunXing_BYTEOFFSET, ZS_ZhiBanYunXing_BITOFFSET, ZS_ZhiBanYunXing_LEN, (uint8_t *)devStatusPtr, dataPoints->valueZS_ZhiBanYunXing);
-	gizStandardCompressValue(ZS_FuYaYunXing_BYTEOFFSET, ZS_FuYaYunXing_BITOFFSET, ZS_FuYaYunXing_LEN, (uint8_t *)devStatusPtr, dataPoints->valueZS_FuYaYunXing);
-	gizStandardCompressValue(ZS_JiZuGuZhang_BYTEOFFSET, ZS_JiZuGuZhang_BITOFFSET, ZS_JiZuGuZhang_LEN, (uint8_t *)devStatusPtr, dataPoints->valueZS_JiZuGuZhang);
-	gizStandardCompressValue(ZS_GaoXiaoZuSe_BYTEOFFSET, ZS_GaoXiaoZuSe_BITOFFSET, ZS_GaoXiaoZuSe_LEN, (uint8_t *)devStatusPtr, dataPoints->valueZS_GaoXiaoZuSe);
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
+	{
+		dp = &gizDataPoints[i];
+		if (GIZ_DP_BOOL == dp->type)
+		{
+			gizStandardCompressValue(dp->status, dp->bitOffset, dp->bitLen, (uint8_t *)devStatusPtr, gizDataPointGet(dataPoints, dp));
+		}
+	}
 	gizByteOrderExchange((uint8_t *)devStatusPtr->wBitBuf, sizeof(devStatusPtr->wBitBuf));
 	gizByteOrderExchange((uint8_t *)devStatusPtr->rBitBuf, sizeof(devStatusPtr->rBitBuf));
 
-
-	devStatusPtr->valueWenDuSet = exchangeBytes(gizY2X(WenDuSet_RATIO, WenDuSet_ADDITION, dataPoints->valueWenDuSet));
-	devStatusPtr->valueShiDuSet = exchangeBytes(gizY2X(ShiDuSet_RATIO, ShiDuSet_ADDITION, dataPoints->valueShiDuSet));
-	devStatusPtr->valueYaChaSet = exchangeBytes(gizY2X(YaChaSet_RATIO, YaChaSet_ADDITION, dataPoints->valueYaChaSet));
-	devStatusPtr->valueWenDuZhi = exchangeBytes(gizY2X(WenDuZhi_RATIO, WenDuZhi_ADDITION, dataPoints->valueWenDuZhi));
-	devStatusPtr->valueShiDuZhi = exchangeBytes(gizY2X(ShiDuZhi_RATIO, ShiDuZhi_ADDITION, dataPoints->valueShiDuZhi));
-	devStatusPtr->valueYaChaZhi = exchangeBytes(gizY2X(YaChaZhi_RATIO, YaChaZhi_ADDITION, dataPoints->valueYaChaZhi));
-	devStatusPtr->valueLengShuiFa = exchangeBytes(gizY2X(LengShuiFa_RATIO, LengShuiFa_ADDITION, dataPoints->valueLengShuiFa));
-	devStatusPtr->valueReShuiFa = exchangeBytes(gizY2X(ReShuiFa_RATIO, ReShuiFa_ADDITION, dataPoints->valueReShuiFa));
-	devStatusPtr->valueJiaShuiQi = exchangeBytes(gizY2X(JiaShuiQi_RATIO, JiaShuiQi_ADDITION, dataPoints->valueJiaShuiQi));
-
-
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
+	{
+		dp = &gizDataPoints[i];
+		if (GIZ_DP_VALUE == dp->type)
+		{
+			raw = exchangeBytes(gizY2X(dp->ratio, dp->addition, gizDataPointGet(dataPoints, dp)));
+			memcpy((uint8_t *)devStatusPtr + dp->status, &raw, sizeof(raw));
+		}
+	}
 
 	return 0;
 }
@@ -373,7 +585,7 @@ static int8_t gizProtocolIssuedProcess(char *did, uint8_t *inData, uint32_t inLe
 
 	if ((NULL == inData) || (NULL == outData) || (NULL == outLen))
 	{
-		GIZWITS_LOG("gizProtocolIssuedProcess Error , Illegal Param\n");
+		LOG_ERROR("gizProtocolIssuedProcess Error , Illegal Param\n");
 		return -1;
 	}
 
@@ -434,14 +646,14 @@ static int8_t gizProtocolIssuedProcess(char *did, uint8_t *inData, uint32_t inLe
 static int32_t gizProtocolIssuedDataAck(protocolHead_t *head, uint8_t *gizdata, uint32_t len, uint8_t proFlag)//协议数据发布应答
 {
 	int32_t ret = 0;
-	uint8_t tx_buf[RB_MAX_LEN];
+	uint8_t tx_buf[MAX_PACKAGE_LEN * 2];
 	uint32_t offset = 0;
 	uint8_t sDidLen = 0;
 	uint16_t data_len = 0;
 	uint8_t *pTxBuf = tx_buf;
 	if (NULL == gizdata)
 	{
-		GIZWITS_LOG("[ERR]  data Is Null \n");
+		LOG_ERROR("[ERR]  data Is Null \n");
 		return -1;
 	}
 
@@ -455,7 +667,7 @@ static int32_t gizProtocolIssuedDataAck(protocolHead_t *head, uint8_t *gizdata,
 	{
 		data_len = 5 + len;
 	}
-	GIZWITS_LOG("len = %d , sDidLen = %d ,data_len = %d\n", len, sDidLen, data_len);
+	LOG_DEBUG("len = %d , sDidLen = %d ,data_len = %d\n", len, sDidLen, data_len);
 	*pTxBuf++ = 0xFF;
 	*pTxBuf++ = 0xFF;
 	*pTxBuf++ = (uint8_t)(data_len >> 8);
@@ -483,7 +695,7 @@ static int32_t gizProtocolIssuedDataAck(protocolHead_t *head, uint8_t *gizdata,
 	ret = uartWrite(tx_buf, data_len + 4);
 	if (ret < 0)
 	{
-		GIZWITS_LOG("uart write error %d \n", ret);
+		LOG_ERROR("uart write error %d \n", ret);
 		return -2;
 	}
 
@@ -504,11 +716,12 @@ static int32_t gizProtocolIssuedDataAck(protocolHead_t *head, uint8_t *gizdata,
 static int32_t gizReportData(uint8_t action, uint8_t *gizdata, uint32_t len)
 {
 	int32_t ret = 0;
+	uartTxHandle_t txHandle = 0;
 	protocolReport_t protocolReport;
 
 	if (NULL == gizdata)
 	{
-		GIZWITS_LOG("gizReportData Error , Illegal Param\n");
+		LOG_ERROR("gizReportData Error , Illegal Param\n");
 		return -1;
 	}
 	gizProtocolHeadInit((protocolHead_t *)&protocolReport);
@@ -519,22 +732,281 @@ static int32_t gizReportData(uint8_t action, uint8_t *gizdata, uint32_t len)
 	memcpy((gizwitsReport_t *)&protocolReport.reportData, (gizwitsReport_t *)gizdata, len);
 	protocolReport.sum = gizProtocolSum((uint8_t *)&protocolReport, sizeof(protocolReport_t));
 
-	ret = uartWrite((uint8_t *)&protocolReport, sizeof(protocolReport_t));
+	ret = uartWriteAsync((uint8_t *)&protocolReport, sizeof(protocolReport_t), &txHandle);
 	if (ret < 0)
 	{
-		GIZWITS_LOG("ERR: uart write error %d \n", ret);
-		return -2;
+		LOG_ERROR("ERR: uart write error %d \n", ret);
+		ret = -2;
 	}
 
-	gizProtocolWaitAck((uint8_t *)&protocolReport, sizeof(protocolReport_t));
+	//registered even when the TX ring refused it: the handle stays 0, so the resend timer sends it
+	gizProtocolWaitAck((uint8_t *)&protocolReport, sizeof(protocolReport_t), txHandle);
 
 	return ret;
-}/**
+}
+
+/**
+* @brief One field of a packed status in wire units	读取数据点
+
+* Bools as 0/1, values as the raw x of y = ratio * x + addition.
+
+* @param [in] status : packed status, as in a P0 report
+* @param [in] dp     : the field's gizDataPoints entry
+*
+* @return the field value
+*/
+static uint32_t gizDevStatusGet(const devStatus_t *status, const gizDataPoint_t *dp)
+{
+	const uint8_t *buf = (const uint8_t *)status;
+	uint32_t start = offsetof(devStatus_t, wBitBuf);
+	uint32_t len = sizeof(status->wBitBuf);
+
+	if (GIZ_DP_VALUE == dp->type)
+	{
+		return ((uint32_t)buf[dp->status] << 8) | buf[dp->status + 1];
+	}
+	if (offsetof(devStatus_t, rBitBuf) <= dp->status)
+	{
+		start = offsetof(devStatus_t, rBitBuf);
+		len = sizeof(status->rBitBuf);
+	}
+	//the bit buffers went through gizByteOrderExchange
+	return (buf[start + len - 1 - (dp->status - start)] >> dp->bitOffset) & ((1UL << dp->bitLen) - 1);
+}
+
+static uint8_t gizVarintPut(uint8_t *out, uint32_t value)
+{
+	uint8_t len = 0;
+
+	while (0x80 <= value)
+	{
+		out[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	out[len++] = (uint8_t)value;
+	return len;
+}
+
+/**
+* @brief Compact report encoding	紧凑报告编码
+
+* byte 0     : GIZ_COMPACT_KEY, GIZ_COMPACT_DELTA or GIZ_COMPACT_REPLAY, plus the sequence number
+* replay only: age of the status in seconds plus one, 0 when unknown
+* delta only : bitmap of the fields that differ from last, bit n for gizDataPoints[n]
+* then every field of the bitmap (all of them in a keyframe or replay) in table order: bools 0/1,
+* values absolute in a keyframe or replay and zigzag(cur - last) in a delta; all LEB128 varints.
+* A single flipped bit takes 3 or 4 bytes, a status report 21.
+
+* @param [in]  cur  : status to send
+* @param [in]  last : status the receiver holds, used by a delta only
+* @param [in]  type : GIZ_COMPACT_KEY, GIZ_COMPACT_DELTA or GIZ_COMPACT_REPLAY
+* @param [in]  age  : replay only, as sent
+* @param [in]  seq  : sequence number
+* @param [out] out  : at least GIZ_COMPACT_MAX + 1 bytes
+*
+* @return payload length, 0 when it does not fit GIZ_COMPACT_MAX
+*/
+static uint16_t gizCompactEncode(const devStatus_t *cur, const devStatus_t *last, uint8_t type, uint32_t age, uint8_t seq, uint8_t *out)
+{
+	uint8_t key = (GIZ_COMPACT_DELTA != type) ? 1 : 0;
+	uint32_t changed = 0;
+	uint32_t value;
+	int32_t delta;
+	uint16_t len = 1;
+	uint8_t i;
+
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
+	{
+		if (key || (gizDevStatusGet(cur, &gizDataPoints[i]) != gizDevStatusGet(last, &gizDataPoints[i])))
+		{
+			changed |= 1UL << i;
+		}
+	}
+
+	out[0] = type | (seq & GIZ_COMPACT_SEQ);
+	if (GIZ_COMPACT_REPLAY == type)
+	{
+		len += gizVarintPut(&out[len], age);
+	}
+	else if (!key)
+	{
+		len += gizVarintPut(&out[len], changed);
+	}
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
+	{
+		if (0 == (changed & (1UL << i)))
+		{
+			continue;
+		}
+		if (GIZ_COMPACT_MAX < len + 3)
+		{
+			return 0;
+		}
+		value = gizDevStatusGet(cur, &gizDataPoints[i]);
+		if (!key && (GIZ_DP_VALUE == gizDataPoints[i].type))
+		{
+			delta = (int32_t)value - (int32_t)gizDevStatusGet(last, &gizDataPoints[i]);
+			value = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+		}
+		len += gizVarintPut(&out[len], value);
+	}
+	return len;
+}
+
+/**
+* @brief Send a status report	发送状态报告
+
+* As a P0 status report, or with SETTINGS_KEY_COMPACT_REPORT set as a compact frame through
+* gizwitsPassthroughData: a keyframe for a full report and every REPORT_KEYFRAME_NUM frames,
+* a replay carrying its age for a report from the backlog, a delta against the previous frame
+* otherwise. The P0 status layout has no room for the age, there the cloud gets the status only.
+
+* @param [in] status : packed status
+* @param [in] full   : 1, periodic full report
+* @param [in] source : ackReportSource_t, recorded in the ACK window with the status
+* @param [in] time   : gizGetTimerCount when the status was taken
+* @return none
+*/
+static void gizStatusReport(devStatus_t *status, uint8_t full, uint8_t source, uint32_t time)
+{
+	static devStatus_t compactLast;
+	static uint8_t compactSeq = 0;
+	uint8_t buf[GIZ_COMPACT_MAX + 1];
+	uint8_t type = GIZ_COMPACT_DELTA;
+	uint32_t age = 0;
+	uint16_t len = 0;
+
+	if (1 == settingsGet(SETTINGS_KEY_COMPACT_REPORT, 0))
+	{
+		if (ACK_REPORT_BACKLOG == source)
+		{
+			type = GIZ_COMPACT_REPLAY;
+			age = (BACKLOG_TIME_UNKNOWN == time) ? 0 : (gizGetTimerCount() - time) / 1000 + 1;
+		}
+		else if (full || (REPORT_KEYFRAME_NUM <= gizCompactDeltas))
+		{
+			type = GIZ_COMPACT_KEY;
+		}
+		len = gizCompactEncode(status, &compactLast, type, age, compactSeq, buf);
+	}
+	if (0 == len)
+	{
+		gizReportData(ACTION_REPORT_DEV_STATUS, (uint8_t *)status, sizeof(devStatus_t));
+		gizProtocolWaitAckReport(source, time, status);
+		gizCompactDeltas = REPORT_KEYFRAME_NUM;			//the next compact frame starts from a keyframe
+		return;
+	}
+
+	gizwitsPassthroughData(buf, len);
+	gizProtocolWaitAckReport(source, time, status);
+	memcpy((uint8_t *)&compactLast, (uint8_t *)status, sizeof(devStatus_t));
+	compactSeq++;
+	gizCompactDeltas = (GIZ_COMPACT_DELTA == type) ? gizCompactDeltas + 1 : 0;
+}
+
+/* Data points whose changes are transitions to replay, not levels that may be merged: the bool ones */
+static uint32_t gizDataPointsBool(void)
+{
+	uint32_t mask = 0;
+	uint8_t i;
+
+	for (i = 0; i < GIZ_DATAPOINT_COUNT; i++)
+	{
+		if (GIZ_DP_BOOL == gizDataPoints[i].type)
+		{
+			mask |= 1UL << i;
+		}
+	}
+	return mask;
+}
+
+/* Reports go to the backlog while the module has no cloud connection or is being recovered, and until the backlog is empty */
+static uint8_t gizBacklogQueued(void)
+{
+	return (gizwitsProtocol.m2mOffline || (LINK_BACKOFF < gizwitsProtocol.link.stage) || (0 < backlogCount())) ? 1 : 0;
+}
+
+/**
+* @brief Send the oldest queued report	发送离线缓存
+
+* One report per REPORT_BACKLOG_TIME while the link is up and at most half the ACK window is in
+* use, so the backlog does not crowd out everything else on the slow link. The report stays
+* queued until its ACK, so only one is in flight and a report given up is simply sent again;
+* gizProtocolWaitAckCheck takes it off the backlog, and sends the full status once it is empty.
+
+* @param none
+* @return none
+*/
+static void gizBacklogDrain(void)
+{
+	static uint32_t lastDrainTime = 0;
+	backlogEntry_t entry;
+	uint8_t inFlight = 0;
+	uint8_t i;
+
+	if (gizwitsProtocol.m2mOffline || (LINK_UP != gizwitsProtocol.link.stage) || (0 == backlogCount()) ||
+		(REPORT_BACKLOG_TIME > gizGetTimerCount() - lastDrainTime))
+	{
+		return;
+	}
+	for (i = 0; i < ACK_WINDOW_SIZE; i++)
+	{
+		if (ACK_REPORT_BACKLOG == gizwitsProtocol.waitAck[i].reportSource)
+		{
+			return;
+		}
+		inFlight += gizwitsProtocol.waitAck[i].flag;
+	}
+	if (ACK_WINDOW_SIZE / 2 <= inFlight)
+	{
+		return;
+	}
+
+	if (0 == backlogPeek(&entry))
+	{
+		if (BACKLOG_TIME_UNKNOWN == entry.time)
+		{
+			LOG_INFO("backlog: report taken before the reset, %d queued\n", backlogCount());
+		}
+		else
+		{
+			LOG_INFO("backlog: report taken %ds ago, %d queued\n", (gizGetTimerCount() - entry.time) / 1000, backlogCount());
+		}
+		memcpy((uint8_t *)&gizwitsProtocol.reportData.devStatus, (uint8_t *)&entry.status, sizeof(devStatus_t));
+		gizStatusReport(&gizwitsProtocol.reportData.devStatus, 0, ACK_REPORT_BACKLOG, entry.time);
+		lastDrainTime = gizGetTimerCount();
+	}
+}
+
+/* ACK of a report sent by gizBacklogDrain: take it off the backlog, unless a requeued or dropped report changed the head since */
+static void gizBacklogAcked(const protocolWaitAck_t *waitAck)
+{
+	backlogEntry_t entry;
+
+	if ((0 != backlogPeek(&entry)) || (entry.time != waitAck->reportTime) ||
+		(0 != memcmp((const uint8_t *)&entry.status, (const uint8_t *)&waitAck->reportStatus, sizeof(devStatus_t))))
+	{
+		return;
+	}
+	backlogPop(&entry);
+	if (0 == backlogCount())
+	{
+		gizwitsProtocol.link.reportForce = 1;
+	}
+}
+
+/**
  * @brief Datapoints reporting mechanism		数据点报告机制
  *
- * 1. Changes are reported immediately			立即更改报告
-
- * 2. Data timing report , 600000 Millisecond	数据定时报告，600000毫秒
+ * 1. Changes are reported by the policy of each data point in gizDataPoints[]	按数据点策略报告更改
+ *    (minimum interval, deadband, maximum staleness); the report carries every field
+
+ * 2. Data timing report , every SETTINGS_KEY_HEARTBEAT seconds (600 by default)	数据定时报告
+ *    and once when the link comes back from an outage
+ * 3. While the cloud is out of reach changes go into the backlog instead, and until
+ *    it has drained new ones queue behind it, so the cloud sees every transition in order	离线缓存
+ *    The report is due when its deadline has passed, however late the loop gets there;
+ *    the next deadline is one period on, or one period from now if a whole period was missed
  *
  *@param [in] currentData       : Current datapoints value	当前数据点值
  * @return : NULL
@@ -543,137 +1015,180 @@ static void gizDevReportPolicy(dataPoint_t *currentData)
 {
 	static uint32_t lastRepTime = 0;
 	uint32_t timeNow = gizGetTimerCount();
+	uint32_t period = settingsGet(SETTINGS_KEY_HEARTBEAT, REPORT_HEARTBEAT_DEFAULT);
+	uint32_t due;
+	uint8_t queued;
+
+	gizBacklogDrain();
+	queued = gizBacklogQueued();
+
+	if (period < REPORT_HEARTBEAT_MIN)
+	{
+		period = REPORT_HEARTBEAT_MIN;
+	}
+	period *= 1000;
 
-	if ((1 == gizCheckReport(currentData, (dataPoint_t *)&gizwitsProtocol.gizLastDataPoint)))
+	if ((1 == gizCheckReport(currentData, (dataPoint_t *)&gizwitsProtocol.gizLastDataPoint, &due)))
 	{
-		GIZWITS_LOG("changed, report data\n");
+		LOG_DEBUG("changed, report data\n");
 		if (0 == gizDataPoints2ReportData(currentData, &gizwitsProtocol.reportData.devStatus))
 		{
-			gizReportData(ACTION_REPORT_DEV_STATUS, (uint8_t *)&gizwitsProtocol.reportData.devStatus, sizeof(devStatus_t));
+			if (queued)
+			{
+				backlogPush(timeNow, &gizwitsProtocol.reportData.devStatus,
+					0 == (gizDataPointsChanged(currentData, (dataPoint_t *)&gizwitsProtocol.gizLastDataPoint) & gizDataPointsBool()));
+			}
+			else
+			{
+				gizStatusReport(&gizwitsProtocol.reportData.devStatus, 0, ACK_REPORT_LIVE, timeNow);
+			}
 		}
+		gizDataPointsReported(currentData, (dataPoint_t *)&gizwitsProtocol.gizLastDataPoint, due);
 		memcpy((uint8_t *)&gizwitsProtocol.gizLastDataPoint, (uint8_t *)currentData, sizeof(dataPoint_t));
 	}
 
-	if ((0 == (timeNow % (600000))) && (lastRepTime != timeNow))
+	if (((timeNow - lastRepTime >= period) || (1 == gizwitsProtocol.link.reportForce)) && !queued)
 	{
-		GIZWITS_LOG("Info: 600S report data\n");
+		LOG_DEBUG("Info: full report data\n");
 		if (0 == gizDataPoints2ReportData(currentData, &gizwitsProtocol.reportData.devStatus))
 		{
-			gizReportData(ACTION_REPORT_DEV_STATUS, (uint8_t *)&gizwitsProtocol.reportData.devStatus, sizeof(devStatus_t));
+			gizStatusReport(&gizwitsProtocol.reportData.devStatus, 1, ACK_REPORT_LIVE, timeNow);
 		}
+		gizDataPointsReported(currentData, (dataPoint_t *)&gizwitsProtocol.gizLastDataPoint, 0);
 		memcpy((uint8_t *)&gizwitsProtocol.gizLastDataPoint, (uint8_t *)currentData, sizeof(dataPoint_t));
 
-		lastRepTime = timeNow;
+		gizwitsProtocol.link.reportForce = 0;
+
+		if (timeNow - lastRepTime >= period)
+		{
+			lastRepTime += period;
+			if (timeNow - lastRepTime >= period)
+			{
+				lastRepTime = timeNow;					//missed a whole period, no burst of catch-up reports
+			}
+		}
 	}
 }
 
+/* Next readable span; after a ring overrun the bytes no longer join up, so hunt for a header again */
+static int32_t gizProtocolFramerPeek(rb_t *rb, uint8_t **span)
+{
+	protocolFramer_t *framer = &gizwitsProtocol.framer;
+	int32_t spanLen = rbPeek(rb, span);
+
+	if (framer->rbDropped != rb->rbDropped)
+	{
+		LOG_WARN("Warning: %d received bytes overrun\n", rb->rbDropped - framer->rbDropped);
+		framer->rbDropped = rb->rbDropped;
+		framer->overruns += framer->inFrame;
+		framer->inFrame = 0;
+		framer->lastData = 0;
+	}
+	return spanLen;
+}
+
 /**
 * @brief Get a packet of data from the ring buffer 从环形缓冲区获取数据包
 *
+* The readable spans of the ring are scanned in place. Header search, 0xFF 0x55 de-stuffing,
+* length check and checksum all run byte by byte, and the parser state is kept in
+* gizwitsProtocol.framer, so a frame may arrive over any number of calls. A frame cut by
+* a ring overrun is abandoned rather than joined to the bytes after the gap.
+* The same output buffer must be passed on every call.
+*
 * @param [in]  rb                  : Input data address		输入数据的地址
 * @param [out] data                : Output data address	输出数据的地址
 * @param [out] len                 : Output data length		输出数据长度
 *
-* @return : 0,Return correct ;-1，Return failure;-2，Data check failure
+* @return : 0,Return correct ;-1，Return failure;-2，Data check failure;1，Frame not complete yet
 */
 static int8_t gizProtocolGetOnePacket(rb_t *rb, uint8_t *gizdata, uint16_t *len)
 {
-	int32_t ret = 0;
-	uint8_t sum = 0;
 	int32_t i = 0;
+	int32_t spanLen = 0;
+	uint8_t *span = NULL;
 	uint8_t tmpData;
-	uint8_t tmpLen = 0;
-	uint16_t tmpCount = 0;
-	static uint8_t protocolFlag = 0;
-	static uint16_t protocolCount = 0;
-	static uint8_t lastData = 0;
-	static uint8_t debugCount = 0;
-	uint8_t *protocolBuff = gizdata;
-	protocolHead_t *head = NULL;
+	protocolFramer_t *framer = &gizwitsProtocol.framer;
+	PROFILE_SCOPE(PROFILE_GIZ_GET_PACKET);
 
 	if ((NULL == rb) || (NULL == gizdata) || (NULL == len))
 	{
-		GIZWITS_LOG("gizProtocolGetOnePacket Error , Illegal Param\n");
+		LOG_ERROR("gizProtocolGetOnePacket Error , Illegal Param\n");
 		return -1;
 	}
 
-	tmpLen = rbCanRead(rb);
-	if (0 == tmpLen)
+	spanLen = gizProtocolFramerPeek(rb, &span);
+	if (0 >= spanLen)
 	{
 		return -1;
 	}
 
-	for (i = 0; i<tmpLen; i++)
+	while (0 < spanLen)
 	{
-		ret = rbRead(rb, &tmpData, 1);
-		if (0 != ret)
+		for (i = 0; i < spanLen; i++)
 		{
-			if ((0xFF == lastData) && (0xFF == tmpData))
+			tmpData = span[i];
+
+			if (0xFF == framer->lastData)
 			{
-				if (0 == protocolFlag)
+				if (0xFF == tmpData)
 				{
-					protocolBuff[0] = 0xFF;
-					protocolBuff[1] = 0xFF;
-					protocolCount = 2;
-					protocolFlag = 1;
+					//Two raw 0xFF only occur as a header, stuffing never lets them into a body
+					gizdata[0] = 0xFF;
+					gizdata[1] = 0xFF;
+					framer->count = 2;
+					framer->frameLen = 0;
+					framer->sum = 0;
+					framer->inFrame = 1;
+					continue;
 				}
-				else
+
+				if (0x55 == tmpData)
 				{
-					if ((protocolCount > 4) && (protocolCount != tmpCount))
-					{
-						protocolBuff[0] = 0xFF;
-						protocolBuff[1] = 0xFF;
-						protocolCount = 2;
-					}
+					framer->lastData = tmpData;
+					continue;
 				}
 			}
-			else if ((0xFF == lastData) && (0x55 == tmpData))
+
+			framer->lastData = tmpData;
+			if (0 == framer->inFrame)
 			{
+				continue;
 			}
-			else
+
+			gizdata[framer->count++] = tmpData;
+
+			if (4 == framer->count)
 			{
-				if (1 == protocolFlag)
+				framer->frameLen = ((uint16_t)gizdata[2] << 8 | gizdata[3]) + 4;
+				if ((framer->frameLen < sizeof(protocolHead_t) + 1) || (framer->frameLen > MAX_PACKAGE_LEN))
 				{
-					protocolBuff[protocolCount] = tmpData;
-					protocolCount++;
-
-					if (protocolCount > 4)
-					{
-						head = (protocolHead_t *)protocolBuff;
-						tmpCount = exchangeBytes(head->len) + 4;
-						if (protocolCount == tmpCount)
-						{
-							break;
-						}
-					}
+					framer->lenErrors++;
+					framer->inFrame = 0;
+					continue;
 				}
 			}
 
-			lastData = tmpData;
-			debugCount++;
-		}
-	}
-
-	if ((protocolCount > 4) && (protocolCount == tmpCount))
-	{
-		sum = gizProtocolSum(protocolBuff, protocolCount);
+			if (framer->count == framer->frameLen)
+			{
+				framer->inFrame = 0;
+				rbCommit(rb, i + 1);
 
-		if (protocolBuff[protocolCount - 1] == sum)
-		{
-			memcpy(gizdata, protocolBuff, tmpCount);
-			*len = tmpCount;
-			protocolFlag = 0;
+				if (tmpData != framer->sum)
+				{
+					framer->sumErrors++;
+					return -2;
+				}
 
-			protocolCount = 0;
-			debugCount = 0;
-			lastData = 0;
+				*len = framer->count;
+				return 0;
+			}
 
-			return 0;
-		}
-		else
-		{
-			return -2;
+			framer->sum += tmpData;
 		}
+
+		rbCommit(rb, spanLen);
+		spanLen = gizProtocolFramerPeek(rb, &span);
 	}
 
 	return 1;
@@ -687,51 +1202,179 @@ static int8_t gizProtocolGetOnePacket(rb_t *rb, uint8_t *gizdata, uint16_t *len)
 * The protocol data resend when check timeout and meet the resend limiting
 	当检查超时并满足重新发送限制时，协议数据重新发送
 
-* @param none
+* @param [in] waitAck : ACK window entry to resend
 *
-* @return none
+* @return 1, a copy was queued; 0, none: the previous copy is still in the TX ring or the ring is full
 */
-static void gizProtocolResendData(void)
+static uint8_t gizProtocolResendData(protocolWaitAck_t *waitAck)
 {
 	int32_t ret = 0;
 
-	if (0 == gizwitsProtocol.waitAck.flag)
+	if (0 == waitAck->flag)
 	{
-		return;
+		return 0;
+	}
+
+	waitAck->sendTime = gizGetTimerCount();
+	if (0 == uartTxComplete(waitAck->txHandle))
+	{
+		//The previous copy is still queued, do not stack another one behind it
+		return 0;
 	}
 
-	GIZWITS_LOG("Warning: timeout, resend data \n");
+	LOG_WARN("Warning: timeout, resend sn %d \n", waitAck->sn);
 
-	ret = uartWrite(gizwitsProtocol.waitAck.buf, gizwitsProtocol.waitAck.dataLen);
-	if (ret != gizwitsProtocol.waitAck.dataLen)
+	ret = uartWriteAsync(waitAck->buf, waitAck->dataLen, &waitAck->txHandle);
+	if (ret != waitAck->dataLen)
 	{
-		GIZWITS_LOG("ERR: resend data error\n");
+		LOG_ERROR("ERR: resend data error\n");
+		return 0;
 	}
 
-	gizwitsProtocol.waitAck.sendTime = gizGetTimerCount();
+	return 1;
+}
+
+/* Enter a stage of the recovery ladder and take its action */
+static void gizProtocolLinkStage(uint8_t stage)
+{
+	protocolWaitAck_t *oldest;
+	uint8_t i;
+
+	LOG_WARN("Warning: link stage %d -> %d\n", gizwitsProtocol.link.stage, stage);
+	gizwitsProtocol.link.stage = stage;
+	gizwitsProtocol.link.stageTime = gizGetTimerCount();
+
+	if (LINK_RESYNC == stage)
+	{
+		do
+		{
+			//oldest report first, so the backlog sends them again in their order
+			oldest = NULL;
+			for (i = 0; i < ACK_WINDOW_SIZE; i++)
+			{
+				if ((1 == gizwitsProtocol.waitAck[i].flag) &&
+					((NULL == oldest) || ((int32_t)(gizwitsProtocol.waitAck[i].reportTime - oldest->reportTime) < 0)))
+				{
+					oldest = &gizwitsProtocol.waitAck[i];
+				}
+			}
+			if (NULL != oldest)
+			{
+				gizProtocolWaitAckDrop(oldest);
+			}
+		} while (NULL != oldest);
+		gizwitsProtocol.link.resyncs++;
+		gizwitsGetModuleInfo();
+	}
+	else if (LINK_MODULE_RESET == stage)
+	{
+		gizwitsProtocol.link.resets++;
+		gizwitsProtocol.link.moduleResets++;
+		mcuModuleReset(1);
+	}
+}
+
+/**
+* @brief Link recovery ladder	链路恢复
+
+* A message out of resends does not restart the MCU straight away. The ladder climbs one
+* step each time the one below fails, and any ACK or device info request brings it back:
+* 1. LINK_BACKOFF       : LINK_BACKOFF_NUM more resends, still backing off
+* 2. LINK_RESYNC        : the window is given up, its live reports back to the backlog, and a module
+*                         info request probes the module
+* 3. LINK_MODULE_RESET  : G510_RST is pulsed and the module gets LINK_BOOT_TIME to ask for
+*                         the device info, then back to 2
+* 4. mcuRestart, after LINK_RESET_MAX_NUM module resets
+* Only the uplink waits; Modbus and local control keep running throughout.
+
+* @param none
+*
+* @return none
+*/
+static void gizProtocolLinkHandle(void)
+{
+	uint32_t elapsed = gizGetTimerCount() - gizwitsProtocol.link.stageTime;
+
+	switch (gizwitsProtocol.link.stage)
+	{
+	case LINK_RESYNC:
+		if (LINK_RESYNC_TIME <= elapsed)
+		{
+			if (LINK_RESET_MAX_NUM <= gizwitsProtocol.link.resets)
+			{
+				LOG_ERROR("ERR: module silent after %d resets, MCU restart\n", gizwitsProtocol.link.resets);
+				mcuRestart();
+			}
+			gizProtocolLinkStage(LINK_MODULE_RESET);
+		}
+		break;
+	case LINK_MODULE_RESET:
+		if (LINK_RESET_PULSE <= elapsed)
+		{
+			mcuModuleReset(0);
+		}
+		if (LINK_RESET_PULSE + LINK_BOOT_TIME <= elapsed)
+		{
+			gizProtocolLinkStage(LINK_RESYNC);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/* An ACK or a device info request: the module is there, the ladder starts over */
+static void gizProtocolLinkAlive(void)
+{
+	if (LINK_UP != gizwitsProtocol.link.stage)
+	{
+		LOG_WARN("Warning: link back at stage %d\n", gizwitsProtocol.link.stage);
+		mcuModuleReset(0);
+		gizwitsProtocol.link.recoveries++;
+		gizwitsProtocol.link.reportForce = 1;
+		gizwitsProtocol.link.stage = LINK_UP;
+	}
+	gizwitsProtocol.link.resets = 0;
 }
 
 /**
 * @brief Clear the ACK protocol message	清除ACK协议消息
 *
+* The ACK clears the window entry with its SN and the matching command.
+*
 * @param [in] head : Protocol header address	协议头地址
 *
 * @return 0， success; other， failure
 */
 static int8_t gizProtocolWaitAckCheck(protocolHead_t *head)
 {
-	protocolHead_t *waitAckHead = (protocolHead_t *)gizwitsProtocol.waitAck.buf;
+	uint8_t i;
 
 	if (NULL == head)
 	{
-		GIZWITS_LOG("ERR: data is empty \n");
+		LOG_ERROR("ERR: data is empty \n");
 		return -1;
 	}
 
-	if (waitAckHead->cmd + 1 == head->cmd)
+	for (i = 0; i < ACK_WINDOW_SIZE; i++)
 	{
-		memset((uint8_t *)&gizwitsProtocol.waitAck, 0, sizeof(protocolWaitAck_t));
+		if ((1 == gizwitsProtocol.waitAck[i].flag) && (gizwitsProtocol.waitAck[i].sn == head->sn) &&
+			(gizwitsProtocol.waitAck[i].cmd + 1 == head->cmd))
+		{
+			if (0 == gizwitsProtocol.waitAck[i].num)
+			{
+				gizProtocolRttSample(gizGetTimerCount() - gizwitsProtocol.waitAck[i].sendTime);
+			}
+			if (ACK_REPORT_BACKLOG == gizwitsProtocol.waitAck[i].reportSource)
+			{
+				gizBacklogAcked(&gizwitsProtocol.waitAck[i]);
+			}
+			memset((uint8_t *)&gizwitsProtocol.waitAck[i], 0, sizeof(protocolWaitAck_t));
+			gizProtocolLinkAlive();
+			return 0;
+		}
 	}
+	LOG_DEBUG("ACK sn %d cmd %x matches nothing \n", head->sn, head->cmd);
 
 	return 0;
 }
@@ -750,7 +1393,7 @@ static int32_t gizProtocolCommonAck(protocolHead_t *head)
 
 	if (NULL == head)
 	{
-		GIZWITS_LOG("ERR: gizProtocolCommonAck data is empty \n");
+		LOG_ERROR("ERR: gizProtocolCommonAck data is empty \n");
 		return -1;
 	}
 	memcpy((uint8_t *)&ack, (uint8_t *)head, sizeof(protocolHead_t));
@@ -761,7 +1404,7 @@ static int32_t gizProtocolCommonAck(protocolHead_t *head)
 	ret = uartWrite((uint8_t *)&ack, sizeof(protocolCommon_t));
 	if (ret < 0)
 	{
-		GIZWITS_LOG("ERR: uart write error %d \n", ret);
+		LOG_ERROR("ERR: uart write error %d \n", ret);
 	}
 
 	return ret;
@@ -770,7 +1413,9 @@ static int32_t gizProtocolCommonAck(protocolHead_t *head)
 /**
 * @brief ACK processing function	ACK处理函数
 
-* Time-out 200ms no ACK resend，resend two times at most 超时200 ms没有ACK重发,重发两次
+* Every entry of the ACK window has its own timer and resend count
+* Time-out no ACK resend, the timeout doubling each time，超时没有ACK重发
+* after SEND_MAX_NUM resends hand over to the recovery ladder
 
 * @param none
 *
@@ -778,22 +1423,48 @@ static int32_t gizProtocolCommonAck(protocolHead_t *head)
 */
 static void gizProtocolAckHandle(void)
 {
-	if (1 == gizwitsProtocol.waitAck.flag)
+	protocolWaitAck_t *waitAck;
+	uint8_t i;
+
+	gizProtocolLinkHandle();
+	if (LINK_BACKOFF < gizwitsProtocol.link.stage)
+	{
+		return;
+	}
+
+	for (i = 0; i < ACK_WINDOW_SIZE; i++)
 	{
-		if (SEND_MAX_NUM > gizwitsProtocol.waitAck.num)
+		waitAck = &gizwitsProtocol.waitAck[i];
+		if (1 != waitAck->flag)
 		{
-			// Time-out no ACK resend
-			if (SEND_MAX_TIME < (gizGetTimerCount() - gizwitsProtocol.waitAck.sendTime))
-			{
-				GIZWITS_LOG("Warning:gizProtocolResendData %d %d %d\n", gizGetTimerCount(), gizwitsProtocol.waitAck.sendTime, gizwitsProtocol.waitAck.num);
-				gizProtocolResendData();
-				gizwitsProtocol.waitAck.num++;
-			}
+			continue;
 		}
-		else
+		if (SEND_MAX_NUM + LINK_BACKOFF_NUM <= waitAck->num)
 		{
-			//memset((uint8_t *)&gizwitsProtocol.waitAck, 0, sizeof(protocolWaitAck_t));
-			mcuRestart();
+			LOG_ERROR("ERR: sn %d never acknowledged\n", waitAck->sn);
+			gizProtocolLinkStage(LINK_RESYNC);
+			return;
+		}
+
+		// Time-out no ACK resend
+		if (waitAck->timeout < (gizGetTimerCount() - waitAck->sendTime))
+		{
+			LOG_WARN("Warning:gizProtocolResendData %d %d %d\n", gizGetTimerCount(), waitAck->sendTime, waitAck->num);
+			if (0 == gizProtocolResendData(waitAck))
+			{
+				continue;						//nothing went out, a stalled or full TX ring is not a silent module
+			}
+			if (SEND_MAX_NUM == waitAck->num)
+			{
+				gizwitsProtocol.link.backoffs++;
+				if (LINK_UP == gizwitsProtocol.link.stage)
+				{
+					gizProtocolLinkStage(LINK_BACKOFF);
+				}
+			}
+			waitAck->num++;
+			waitAck->timeout = gizProtocolResendTimeout(waitAck->num);
+			gizwitsProtocol.rtt.resends++;
 		}
 	}
 }
@@ -812,7 +1483,7 @@ static int32_t gizProtocolGetDeviceInfo(protocolHead_t * head)
 
 	if (NULL == head)
 	{
-		GIZWITS_LOG("gizProtocolGetDeviceInfo Error , Illegal Param\n");
+		LOG_ERROR("gizProtocolGetDeviceInfo Error , Illegal Param\n");
 		return -1;
 	}
 
@@ -835,7 +1506,7 @@ static int32_t gizProtocolGetDeviceInfo(protocolHead_t * head)
 	ret = uartWrite((uint8_t *)&deviceInfo, sizeof(protocolDeviceInfo_t));
 	if (ret < 0)
 	{
-		GIZWITS_LOG("ERR: uart write error %d \n", ret);
+		LOG_ERROR("ERR: uart write error %d \n", ret);
 	}
 
 	return ret;
@@ -855,7 +1526,7 @@ static int32_t gizProtocolErrorCmd(protocolHead_t *head, errorPacketsType_t errn
 
 	if (NULL == head)
 	{
-		GIZWITS_LOG("gizProtocolErrorCmd Error , Illegal Param\n");
+		LOG_ERROR("gizProtocolErrorCmd Error , Illegal Param\n");
 		return -1;
 	}
 	gizProtocolHeadInit((protocolHead_t *)&errorType);
@@ -869,7 +1540,7 @@ static int32_t gizProtocolErrorCmd(protocolHead_t *head, errorPacketsType_t errn
 	ret = uartWrite((uint8_t *)&errorType, sizeof(protocolErrorType_t));
 	if (ret < 0)
 	{
-		GIZWITS_LOG("ERR: uart write error %d \n", ret);
+		LOG_ERROR("ERR: uart write error %d \n", ret);
 	}
 
 	return ret;
@@ -888,7 +1559,7 @@ static int8_t gizProtocolNTP(protocolHead_t *head)
 
 	if (NULL == head)
 	{
-		GIZWITS_LOG("ERR: NTP is empty \n");
+		LOG_ERROR("ERR: NTP is empty \n");
 		return -1;
 	}
 
@@ -933,7 +1604,7 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 
 	if (NULL == status)
 	{
-		GIZWITS_LOG("gizProtocolModuleStatus Error , Illegal Param\n");
+		LOG_ERROR("gizProtocolModuleStatus Error , Illegal Param\n");
 		return -1;
 	}
 
@@ -948,14 +1619,14 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 			{
 				gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_SOFTAP;
 				gizwitsProtocol.wifiStatusEvent.num++;
-				GIZWITS_LOG("OnBoarding: SoftAP or Web mode\n");
+				LOG_INFO("OnBoarding: SoftAP or Web mode\n");
 			}
 
 			if (1 == status->ststus.types.station)
 			{
 				gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_AIRLINK;
 				gizwitsProtocol.wifiStatusEvent.num++;
-				GIZWITS_LOG("OnBoarding: AirLink mode\n");
+				LOG_INFO("OnBoarding: AirLink mode\n");
 			}
 		}
 		else
@@ -964,14 +1635,14 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 			{
 				gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_SOFTAP;
 				gizwitsProtocol.wifiStatusEvent.num++;
-				GIZWITS_LOG("OnBoarding: SoftAP or Web mode\n");
+				LOG_INFO("OnBoarding: SoftAP or Web mode\n");
 			}
 
 			if (1 == status->ststus.types.station)
 			{
 				gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_STATION;
 				gizwitsProtocol.wifiStatusEvent.num++;
-				GIZWITS_LOG("OnBoarding: Station mode\n");
+				LOG_INFO("OnBoarding: Station mode\n");
 			}
 		}
 	}
@@ -984,13 +1655,13 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_OPEN_BINDING;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: in binding mode\n");
+			LOG_INFO("WiFi status: in binding mode\n");
 		}
 		else
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_CLOSE_BINDING;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: out binding mode\n");
+			LOG_INFO("WiFi status: out binding mode\n");
 		}
 	}
 
@@ -1002,17 +1673,18 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_CON_ROUTER;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: connected router\n");
+			LOG_INFO("WiFi status: connected router\n");
 		}
 		else
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_DISCON_ROUTER;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: disconnected router\n");
+			LOG_INFO("WiFi status: disconnected router\n");
 		}
 	}
 
 	//M2M server status
+	gizwitsProtocol.m2mOffline = (1 == status->ststus.types.con_m2m) ? 0 : 1;
 	if (lastStatus.types.con_m2m != status->ststus.types.con_m2m)
 	{
 		lastStatus.types.con_m2m = status->ststus.types.con_m2m;
@@ -1020,13 +1692,13 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_CON_M2M;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: connected m2m\n");
+			LOG_INFO("WiFi status: connected m2m\n");
 		}
 		else
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_DISCON_M2M;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: disconnected m2m\n");
+			LOG_INFO("WiFi status: disconnected m2m\n");
 		}
 	}
 
@@ -1038,13 +1710,13 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_CON_APP;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: app connect\n");
+			LOG_INFO("WiFi status: app connect\n");
 		}
 		else
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_DISCON_APP;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: no app connect\n");
+			LOG_INFO("WiFi status: no app connect\n");
 		}
 	}
 
@@ -1056,20 +1728,20 @@ static int8_t gizProtocolModuleStatus(protocolWifiStatus_t *status)
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_OPEN_TESTMODE;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: in test mode\n");
+			LOG_INFO("WiFi status: in test mode\n");
 		}
 		else
 		{
 			gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_CLOSE_TESTMODE;
 			gizwitsProtocol.wifiStatusEvent.num++;
-			GIZWITS_LOG("WiFi status: out test mode\n");
+			LOG_INFO("WiFi status: out test mode\n");
 		}
 	}
 
 	gizwitsProtocol.wifiStatusEvent.event[gizwitsProtocol.wifiStatusEvent.num] = WIFI_RSSI;
 	gizwitsProtocol.wifiStatusEvent.num++;
 	gizwitsProtocol.wifiStatusData.rssi = status->ststus.types.rssi;
-	GIZWITS_LOG("RSSI is %d \n", gizwitsProtocol.wifiStatusData.rssi);
+	LOG_INFO("RSSI is %d \n", gizwitsProtocol.wifiStatusData.rssi);
 
 	gizwitsProtocol.issuedFlag = WIFI_STATUS_TYPE;
 
@@ -1097,14 +1769,17 @@ void gizwitsInit(void)
 	pRb.rbBuff = rbBuf;
 	if (0 == rbCreate(&pRb))
 	{
-		GIZWITS_LOG("rbCreate Success \n");
+		LOG_INFO("rbCreate Success \n");
 	}
 	else
 	{
-		GIZWITS_LOG("rbCreate Faild \n");
+		LOG_ERROR("rbCreate Faild \n");
 	}
 
 	memset((uint8_t *)&gizwitsProtocol, 0, sizeof(gizwitsProtocol_t));
+	gizwitsProtocol.rtt.rto = SEND_MAX_TIME;
+	gizwitsProtocol.rtt.seed = 0x2545F491;
+	backlogInit();
 }
 
 /**
@@ -1124,6 +1799,7 @@ void gizwitsInit(void)
 int32_t gizwitsSetMode(uint8_t mode)
 {
 	int32_t ret = 0;
+	uartTxHandle_t txHandle = 0;
 	protocolCfgMode_t cfgMode;
 	protocolCommon_t setDefault;
 
@@ -1135,13 +1811,13 @@ int32_t gizwitsSetMode(uint8_t mode)
 		setDefault.head.sn = gizwitsProtocol.sn++;
 		setDefault.head.len = exchangeBytes(sizeof(protocolCommon_t) - 4);
 		setDefault.sum = gizProtocolSum((uint8_t *)&setDefault, sizeof(protocolCommon_t));
-		ret = uartWrite((uint8_t *)&setDefault, sizeof(protocolCommon_t));
+		ret = uartWriteAsync((uint8_t *)&setDefault, sizeof(protocolCommon_t), &txHandle);
 		if (ret < 0)
 		{
-			GIZWITS_LOG("ERR: uart write error %d \n", ret);
+			LOG_ERROR("ERR: uart write error %d \n", ret);
 		}
 
-		gizProtocolWaitAck((uint8_t *)&setDefault, sizeof(protocolCommon_t));
+		gizProtocolWaitAck((uint8_t *)&setDefault, sizeof(protocolCommon_t), txHandle);
 		break;
 	case WIFI_SOFTAP_MODE:
 		gizProtocolHeadInit((protocolHead_t *)&cfgMode);
@@ -1150,12 +1826,12 @@ int32_t gizwitsSetMode(uint8_t mode)
 		cfgMode.cfgMode = mode;
 		cfgMode.head.len = exchangeBytes(sizeof(protocolCfgMode_t) - 4);
 		cfgMode.sum = gizProtocolSum((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t));
-		ret = uartWrite((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t));
+		ret = uartWriteAsync((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t), &txHandle);
 		if (ret < 0)
 		{
-			GIZWITS_LOG("ERR: uart write error %d \n", ret);
+			LOG_ERROR("ERR: uart write error %d \n", ret);
 		}
-		gizProtocolWaitAck((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t));
+		gizProtocolWaitAck((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t), txHandle);
 		break;
 	case WIFI_AIRLINK_MODE:
 		gizProtocolHeadInit((protocolHead_t *)&cfgMode);
@@ -1164,12 +1840,12 @@ int32_t gizwitsSetMode(uint8_t mode)
 		cfgMode.cfgMode = mode;
 		cfgMode.head.len = exchangeBytes(sizeof(protocolCfgMode_t) - 4);
 		cfgMode.sum = gizProtocolSum((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t));
-		ret = uartWrite((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t));
+		ret = uartWriteAsync((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t), &txHandle);
 		if (ret < 0)
 		{
-			GIZWITS_LOG("ERR: uart write error %d \n", ret);
+			LOG_ERROR("ERR: uart write error %d \n", ret);
 		}
-		gizProtocolWaitAck((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t));
+		gizProtocolWaitAck((uint8_t *)&cfgMode, sizeof(protocolCfgMode_t), txHandle);
 		break;
 	case WIFI_PRODUCTION_TEST:
 		gizProtocolHeadInit((protocolHead_t *)&setDefault);
@@ -1177,13 +1853,13 @@ int32_t gizwitsSetMode(uint8_t mode)
 		setDefault.head.sn = gizwitsProtocol.sn++;
 		setDefault.head.len = exchangeBytes(sizeof(protocolCommon_t) - 4);
 		setDefault.sum = gizProtocolSum((uint8_t *)&setDefault, sizeof(protocolCommon_t));
-		ret = uartWrite((uint8_t *)&setDefault, sizeof(protocolCommon_t));
+		ret = uartWriteAsync((uint8_t *)&setDefault, sizeof(protocolCommon_t), &txHandle);
 		if (ret < 0)
 		{
-			GIZWITS_LOG("ERR: uart write error %d \n", ret);
+			LOG_ERROR("ERR: uart write error %d \n", ret);
 		}
 
-		gizProtocolWaitAck((uint8_t *)&setDefault, sizeof(protocolCommon_t));
+		gizProtocolWaitAck((uint8_t *)&setDefault, sizeof(protocolCommon_t), txHandle);
 		break;
 	case WIFI_NINABLE_MODE:
 		gizProtocolHeadInit((protocolHead_t *)&setDefault);
@@ -1191,16 +1867,16 @@ int32_t gizwitsSetMode(uint8_t mode)
 		setDefault.head.sn = gizwitsProtocol.sn++;
 		setDefault.head.len = exchangeBytes(sizeof(protocolCommon_t) - 4);
 		setDefault.sum = gizProtocolSum((uint8_t *)&setDefault, sizeof(protocolCommon_t));
-		ret = uartWrite((uint8_t *)&setDefault, sizeof(protocolCommon_t));
+		ret = uartWriteAsync((uint8_t *)&setDefault, sizeof(protocolCommon_t), &txHandle);
 		if (ret < 0)
 		{
-			GIZWITS_LOG("ERR: uart write error %d \n", ret);
+			LOG_ERROR("ERR: uart write error %d \n", ret);
 		}
 
-		gizProtocolWaitAck((uint8_t *)&setDefault, sizeof(protocolCommon_t));
+		gizProtocolWaitAck((uint8_t *)&setDefault, sizeof(protocolCommon_t), txHandle);
 		break;
 	default:
-		GIZWITS_LOG("ERR: CfgMode error!\n");
+		LOG_ERROR("ERR: CfgMode error!\n");
 		break;
 	}
 
@@ -1218,6 +1894,7 @@ int32_t gizwitsSetMode(uint8_t mode)
 void gizwitsGetNTP(void)
 {
 	int32_t ret = 0;
+	uartTxHandle_t txHandle = 0;
 	protocolCommon_t getNTP;
 
 	gizProtocolHeadInit((protocolHead_t *)&getNTP);
@@ -1225,13 +1902,13 @@ void gizwitsGetNTP(void)
 	getNTP.head.sn = gizwitsProtocol.sn++;
 	getNTP.head.len = exchangeBytes(sizeof(protocolCommon_t) - 4);
 	getNTP.sum = gizProtocolSum((uint8_t *)&getNTP, sizeof(protocolCommon_t));
-	ret = uartWrite((uint8_t *)&getNTP, sizeof(protocolCommon_t));
+	ret = uartWriteAsync((uint8_t *)&getNTP, sizeof(protocolCommon_t), &txHandle);
 	if (ret < 0)
 	{
-		GIZWITS_LOG("ERR[NTP]: uart write error %d \n", ret);
+		LOG_ERROR("ERR[NTP]: uart write error %d \n", ret);
 	}
 
-	gizProtocolWaitAck((uint8_t *)&getNTP, sizeof(protocolCommon_t));
+	gizProtocolWaitAck((uint8_t *)&getNTP, sizeof(protocolCommon_t), txHandle);
 }
 
 
@@ -1246,6 +1923,7 @@ void gizwitsGetNTP(void)
 void gizwitsGetModuleInfo(void)
 {
 	int32_t ret = 0;
+	uartTxHandle_t txHandle = 0;
 	protocolGetModuleInfo_t getModuleInfo;
 
 	gizProtocolHeadInit((protocolHead_t *)&getModuleInfo);
@@ -1254,13 +1932,13 @@ void gizwitsGetModuleInfo(void)
 	getModuleInfo.type = 0x0;
 	getModuleInfo.head.len = exchangeBytes(sizeof(protocolGetModuleInfo_t) - 4);
 	getModuleInfo.sum = gizProtocolSum((uint8_t *)&getModuleInfo, sizeof(protocolGetModuleInfo_t));
-	ret = uartWrite((uint8_t *)&getModuleInfo, sizeof(protocolGetModuleInfo_t));
+	ret = uartWriteAsync((uint8_t *)&getModuleInfo, sizeof(protocolGetModuleInfo_t), &txHandle);
 	if (ret < 0)
 	{
-		GIZWITS_LOG("ERR[NTP]: uart write error %d \n", ret);
+		LOG_ERROR("ERR[NTP]: uart write error %d \n", ret);
 	}
 
-	gizProtocolWaitAck((uint8_t *)&getModuleInfo, sizeof(protocolGetModuleInfo_t));
+	gizProtocolWaitAck((uint8_t *)&getModuleInfo, sizeof(protocolGetModuleInfo_t), txHandle);
 }
 
 
@@ -1277,7 +1955,7 @@ static int8_t gizProtocolModuleInfoHandle(protocolHead_t *head)
 
 	if (NULL == head)
 	{
-		GIZWITS_LOG("NTP is empty \n");
+		LOG_ERROR("NTP is empty \n");
 		return -1;
 	}
 
@@ -1306,7 +1984,7 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 #ifdef PROTOCOL_DEBUG
 	uint16_t i = 0;
 #endif
-	uint8_t ackData[RB_MAX_LEN];
+	uint8_t ackData[MAX_PACKAGE_LEN * 2];
 	uint16_t protocolLen = 0;
 	uint32_t ackLen = 0;
 	protocolHead_t *recvHead = NULL;
@@ -1316,7 +1994,7 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 
 	if (NULL == currentData)
 	{
-		GIZWITS_LOG("GizwitsHandle Error , Illegal Param\n");
+		LOG_ERROR("GizwitsHandle Error , Illegal Param\n");
 		return -1;
 	}
 
@@ -1326,15 +2004,15 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 
 	if (0 == ret)
 	{
-		GIZWITS_LOG("Get One Packet!\n");
+		LOG_DEBUG("Get One Packet!\n");
 
 #ifdef PROTOCOL_DEBUG
-		GIZWITS_LOG("WiFi2MCU[%4d:%4d]: ", gizGetTimerCount(), protocolLen);
+		LOG_DEBUG("WiFi2MCU[%4d:%4d]: ", gizGetTimerCount(), protocolLen);
 		for (i = 0; i<protocolLen; i++)
 		{
-			GIZWITS_LOG("%02x ", gizwitsProtocol.protocolBuf[i]);
+			LOG_DEBUG("%02x ", gizwitsProtocol.protocolBuf[i]);
 		}
-		GIZWITS_LOG("\n");
+		LOG_DEBUG("\n");
 #endif
 
 		recvHead = (protocolHead_t *)gizwitsProtocol.protocolBuf;
@@ -1342,15 +2020,16 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 		{
 		case CMD_GET_DEVICE_INTO:
 			gizProtocolGetDeviceInfo(recvHead);
+			gizProtocolLinkAlive();
 			break;
 		case CMD_ISSUED_P0:
-			GIZWITS_LOG("flag %x %x \n", recvHead->flags[0], recvHead->flags[1]);
+			LOG_DEBUG("flag %x %x \n", recvHead->flags[0], recvHead->flags[1]);
 			//offset = 1;
 
 			if (0 == gizProtocolIssuedProcess(didPtr, gizwitsProtocol.protocolBuf + sizeof(protocolHead_t) + offset, protocolLen - (sizeof(protocolHead_t) + offset + 1), ackData, &ackLen))
 			{
 				gizProtocolIssuedDataAck(recvHead, ackData, ackLen, recvHead->flags[1]);
-				GIZWITS_LOG("AckData : \n");
+				LOG_DEBUG("AckData : \n");
 			}
 			break;
 		case CMD_HEARTBEAT:
@@ -1368,7 +2047,7 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 			break;
 		case CMD_MCU_REBOOT:
 			gizProtocolCommonAck(recvHead);
-			GIZWITS_LOG("report:MCU reboot!\n");
+			LOG_INFO("report:MCU reboot!\n");
 
 			gizProtocolReboot();
 			break;
@@ -1376,22 +2055,22 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 			break;
 		case ACK_PRODUCTION_TEST:
 			gizProtocolWaitAckCheck(recvHead);
-			GIZWITS_LOG("Ack PRODUCTION_MODE success \n");
+			LOG_INFO("Ack PRODUCTION_MODE success \n");
 			break;
 		case ACK_GET_NTP:
 			gizProtocolWaitAckCheck(recvHead);
 			gizProtocolNTP(recvHead);
-			GIZWITS_LOG("Ack GET_UTT success \n");
+			LOG_INFO("Ack GET_UTT success \n");
 			break;
 		case ACK_ASK_MODULE_INFO:
 			gizProtocolWaitAckCheck(recvHead);
 			gizProtocolModuleInfoHandle(recvHead);
-			GIZWITS_LOG("Ack GET_Module success \n");
+			LOG_INFO("Ack GET_Module success \n");
 			break;
 
 		default:
 			gizProtocolErrorCmd(recvHead, ERROR_CMD);
-			GIZWITS_LOG("ERR: cmd code error!\n");
+			LOG_ERROR("ERR: cmd code error!\n");
 			break;
 		}
 	}
@@ -1400,7 +2079,7 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 		//Check failed, report exception
 		recvHead = (protocolHead_t *)gizwitsProtocol.protocolBuf;
 		gizProtocolErrorCmd(recvHead, ERROR_ACK_SUM);
-		GIZWITS_LOG("ERR: check sum error!\n");
+		LOG_ERROR("ERR: check sum error!\n");
 		return -2;
 	}
 
@@ -1452,12 +2131,13 @@ int32_t gizwitsHandle(dataPoint_t *currentData)
 int32_t gizwitsPassthroughData(uint8_t * gizdata, uint32_t len)
 {
 	int32_t ret = 0;
+	uartTxHandle_t txHandle = 0;
 	uint8_t tx_buf[MAX_PACKAGE_LEN];
 	uint8_t *pTxBuf = tx_buf;
 	uint16_t data_len = 6 + len;
-	if (NULL == gizdata)
+	if ((NULL == gizdata) || (MAX_PACKAGE_LEN < data_len + 4))
 	{
-		GIZWITS_LOG("[ERR] gizwitsPassthroughData Error \n");
+		LOG_ERROR("[ERR] gizwitsPassthroughData Error \n");
 		return (-1);
 	}
 
@@ -1474,15 +2154,106 @@ int32_t gizwitsPassthroughData(uint8_t * gizdata, uint32_t len)
 	memcpy(&tx_buf[9], gizdata, len);
 	tx_buf[data_len + 4 - 1] = gizProtocolSum(tx_buf, (data_len + 4));
 
-	ret = uartWrite(tx_buf, data_len + 4);
+	ret = uartWriteAsync(tx_buf, data_len + 4, &txHandle);
 	if (ret < 0)
 	{
-		GIZWITS_LOG("ERR: uart write error %d \n", ret);
+		LOG_ERROR("ERR: uart write error %d \n", ret);
 	}
 
-	gizProtocolWaitAck(tx_buf, data_len + 4);
+	gizProtocolWaitAck(tx_buf, data_len + 4, txHandle);
 
 	return 0;
 }
 
+/**
+* @brief Link diagnostics as Modbus input registers (FC04)	链路诊断
+
+* GIZ_INPUT_BASE + 0: RTO, 1: SRTT, 2: RTTVAR (ms, saturating), 3: link stage, 4: messages waiting
+* for an ACK; then 32-bit counters, high word first: 5 RTT samples, 7 resends, 9 backoffs,
+* 11 resyncs, 13 module resets, 15 recoveries; 17: reports in the backlog, then its counters
+* 18 merged, 20 spilled to flash, 22 dropped; 24 messages given up without an ACK
+
+* @param [in]  addr  : input register address
+* @param [out] value : register value
+*
+* @return 0, success; -1, addr is not a link register
+*/
+int8_t gizwitsInputRegister(uint16_t addr, uint16_t *value)
+{
+	uint32_t field;
+	uint16_t offset;
+	uint8_t counter;
+	uint8_t i;
+
+	if ((GIZ_INPUT_BASE > addr) || (GIZ_INPUT_BASE + GIZ_INPUT_COUNT <= addr))
+	{
+		return -1;
+	}
+	offset = addr - GIZ_INPUT_BASE;
+	switch (offset)
+	{
+	case 0:
+		field = gizwitsProtocol.rtt.rto;
+		break;
+	case 1:
+		field = gizwitsProtocol.rtt.srtt;
+		break;
+	case 2:
+		field = gizwitsProtocol.rtt.rttvar;
+		break;
+	case 3:
+		field = gizwitsProtocol.link.stage;
+		break;
+	case 4:
+		field = 0;
+		for (i = 0; i < ACK_WINDOW_SIZE; i++)
+		{
+			field += gizwitsProtocol.waitAck[i].flag;
+		}
+		break;
+	case 17:
+		field = backlogCount();
+		break;
+	default:
+		counter = (17 > offset) ? (offset - 5) : (offset - 6);
+		switch (counter / 2)
+		{
+		case 0:
+			field = gizwitsProtocol.rtt.samples;
+			break;
+		case 1:
+			field = gizwitsProtocol.rtt.resends;
+			break;
+		case 2:
+			field = gizwitsProtocol.link.backoffs;
+			break;
+		case 3:
+			field = gizwitsProtocol.link.resyncs;
+			break;
+		case 4:
+			field = gizwitsProtocol.link.moduleResets;
+			break;
+		case 5:
+			field = gizwitsProtocol.link.recoveries;
+			break;
+		case 6:
+			field = backlogMerged;
+			break;
+		case 7:
+			field = backlogSpilled;
+			break;
+		case 8:
+			field = backlogDropped;
+			break;
+		default:
+			field = gizwitsProtocol.link.dropped;
+			break;
+		}
+		*value = (counter & 1) ? (field & 0xFFFF) : (field >> 16);
+		return 0;
+	}
+	*value = (0xFFFF < field) ? 0xFFFF : field;
+	return 0;
+}
+
 /**@} */
@@ -27,10 +27,32 @@ extern "C" {
 #include <stdlib.h>
 #include <string.h>
 #include "common.h"
+#include "ringBuffer.h"
 
                                                                                                                   
-#define SEND_MAX_TIME       5000                     ///< 200ms resend
+#define SEND_MAX_TIME       5000                     ///< resend timeout until the first RTT sample
 #define SEND_MAX_NUM        3                      ///< resend times
+#define RTO_MIN             1000                   ///< resend timeout limits, see gizProtocolRttSample
+#define RTO_MAX             60000
+#define RTO_JITTER_SHIFT    2                      ///< up to a quarter of the timeout is added at random
+#define ACK_WINDOW_SIZE     4                      ///< messages that may wait for their ACK at the same time
+
+/**@name Link recovery ladder, see gizProtocolLinkHandle
+* @{
+*/
+#define LINK_BACKOFF_NUM    3                      ///< resends after SEND_MAX_NUM before the window is dropped
+#define LINK_RESYNC_TIME    10000                  ///< wait for the module to answer the resync probe
+#define LINK_RESET_PULSE    200                    ///< G510_RST low time
+#define LINK_BOOT_TIME      60000                  ///< wait for the reset module to ask for the device info
+#define LINK_RESET_MAX_NUM  3                      ///< module resets without an answer before the MCU restarts
+/**@} */
+
+/**@name Modbus input registers (FC04) of the link diagnostics, see gizwitsInputRegister
+* @{
+*/
+#define GIZ_INPUT_BASE      0x0280
+#define GIZ_INPUT_COUNT     26
+/**@} */
                                                     
 #define protocol_VERSION    "00000004"              ///< protocol version
 #define P0_VERSION          "00000002"              ///< P0 protocol version
@@ -49,6 +71,11 @@ extern "C" {
 * @{
 */
 #define REPORT_TIME_MAX 6000 //6S
+#define REPORT_STALE_MAX 60000 //60S, longest a change inside the deadband waits
+#define REPORT_HEARTBEAT_DEFAULT 600 //S, full status report period unless SETTINGS_KEY_HEARTBEAT says otherwise
+#define REPORT_HEARTBEAT_MIN 10 //S
+#define REPORT_BACKLOG_TIME 1000 //1S, one queued report per interval once the cloud is back, see backlog.h
+#define REPORT_KEYFRAME_NUM 32 //compact reports between keyframes, the full report is always one
 /**@} */    
 
 #define CELLNUMMAX 7    
@@ -69,7 +96,7 @@ extern "C" {
 
 
 #define MAX_PACKAGE_LEN    (sizeof(devStatus_t)+sizeof(attrFlags_t)+20)                 ///< Data buffer maximum length
-#define RB_MAX_LEN          (MAX_PACKAGE_LEN*2)     ///< Maximum length of ring buffer
+#define RB_MAX_LEN          256                     ///< Maximum length of ring buffer, a power of two holding at least two packets
 
 /**@name Data point related definition
 * @{
@@ -565,13 +592,28 @@ typedef struct {
     devStatus_t devStatus;                          ///< Stores the device status data
 }gizwitsReport_t;
 
+/** What a status report in the ACK window was sent from, see gizBacklogDrain */
+typedef enum
+{
+    ACK_REPORT_NONE = 0,                            ///< not a status report
+    ACK_REPORT_LIVE,                                ///< sent as it was taken, handed to the backlog if given up
+    ACK_REPORT_BACKLOG,                             ///< the oldest queued report, taken off the backlog by its ACK
+} ackReportSource_t;
+
 /** resend strategy structure */
 typedef struct {
     uint8_t                 num;                    ///< resend times
     uint8_t                 flag;                   ///< 1,Indicates that there is a need to wait for the ACK;0,Indicates that there is no need to wait for the ACK
+    uint8_t                 cmd;                    ///< command of the message, the ACK carries cmd + 1
+    uint8_t                 sn;                     ///< SN of the message, echoed by the ACK
     uint8_t                 buf[MAX_PACKAGE_LEN];   ///< resend data buffer
     uint16_t                dataLen;                ///< resend data length
     uint32_t                sendTime;               ///< resend time
+    uint32_t                timeout;                ///< resend timeout of the copy on the wire, backoff and jitter included
+    uint32_t                txHandle;               ///< transmit position of the last resent copy
+    uint8_t                 reportSource;           ///< ackReportSource_t
+    uint32_t                reportTime;             ///< status reports: gizGetTimerCount when the status was taken
+    devStatus_t             reportStatus;           ///< status reports: the status sent
 } protocolWaitAck_t;
                                                                                 
 /** 4.8 WiFi read device datapoint value , device ack use this struct */
@@ -584,17 +626,69 @@ typedef struct
 } protocolReport_t;
 
 
+/** Link recovery stages, in the order they escalate */
+typedef enum
+{
+    LINK_UP = 0,                                    ///< ACKs arrive, resends at SEND_MAX_TIME
+    LINK_BACKOFF,                                   ///< a message ran out of resends, it goes on with doubling timeouts
+    LINK_RESYNC,                                    ///< window dropped, waiting for the module to answer a module info request
+    LINK_MODULE_RESET,                              ///< G510_RST pulsed, waiting for the module to ask for the device info
+} linkStage_t;
+
+/** Link recovery state and counters */
+typedef struct
+{
+    uint8_t                 stage;                  ///< linkStage_t
+    uint8_t                 resets;                 ///< module resets in the current outage
+    uint8_t                 reportForce;            ///< 1,send the full status once the link is back
+    uint32_t                stageTime;              ///< when the current stage began
+    uint32_t                backoffs;               ///< messages that went into backoff
+    uint32_t                resyncs;                ///< resync probes sent
+    uint32_t                dropped;                ///< messages given up unacknowledged: evicted from a full window or dropped by a resync
+    uint32_t                moduleResets;           ///< G510_RST pulses
+    uint32_t                recoveries;             ///< outages that ended without an MCU restart
+} protocolLink_t;
+
+/** Round trip estimate of the ACKs, RFC 6298 style */
+typedef struct
+{
+    uint32_t                srtt;                   ///< smoothed round trip time, ms
+    uint32_t                rttvar;                 ///< round trip time variation, ms
+    uint32_t                rto;                    ///< resend timeout of a first copy, ms
+    uint32_t                samples;                ///< ACKs of messages that were never resent
+    uint32_t                resends;                ///< copies sent again on timeout
+    uint32_t                seed;                   ///< jitter generator state
+} protocolRtt_t;
+
+/** Serial frame parser state, kept between gizProtocolGetOnePacket calls */
+typedef struct
+{
+    uint8_t                 inFrame;                ///< 1,A header was seen and the frame is being collected;0,Hunting for a header
+    uint8_t                 lastData;               ///< Previous raw byte, used to spot 0xFF 0xFF headers and 0xFF 0x55 stuffing
+    uint8_t                 sum;                    ///< Running checksum of the collected bytes after the header
+    uint16_t                count;                  ///< De-stuffed bytes collected so far
+    uint16_t                frameLen;               ///< Expected frame length from the length field, 0 until it arrives
+    uint32_t                lenErrors;              ///< Frames dropped for a length field out of range
+    uint32_t                sumErrors;              ///< Frames dropped for a checksum mismatch
+    uint32_t                overruns;               ///< Frames cut short by a ring overrun
+    uint32_t                rbDropped;              ///< The ring's rbDropped as last seen, a change means bytes were lost
+} protocolFramer_t;
+
 /** Protocol main and very important struct */
 typedef struct
 {
     uint8_t issuedFlag;                             ///< P0 action type
     uint8_t protocolBuf[MAX_PACKAGE_LEN];           ///< Protocol data handle buffer
+    protocolFramer_t framer;                        ///< Serial frame parser state
     uint8_t transparentBuff[MAX_PACKAGE_LEN];       ///< Transparent data storage area
     uint32_t transparentLen;                        ///< Transmission data length
     
     uint32_t sn;                                    ///< Message SN
     uint32_t timerMsCount;                          ///< Timer Count 
-    protocolWaitAck_t waitAck;                      ///< Protocol wait ACK data structure
+    protocolWaitAck_t waitAck[ACK_WINDOW_SIZE];     ///< Messages waiting for an ACK, matched by SN
+    protocolLink_t link;                            ///< Link recovery state
+    protocolRtt_t rtt;                              ///< ACK round trip estimate
+    uint8_t m2mOffline;                             ///< 1,the module reports no M2M connection, reports are queued
     
     eventInfo_t issuedProcessEvent;                 ///< Control events
     eventInfo_t wifiStatusEvent;                    ///< WIFI Status events
@@ -617,17 +711,67 @@ typedef struct
 
 #pragma pack()
 
+/** Data point descriptor: where one dataPoint_t field lives in the P0 payloads and how it is reported */
+typedef enum
+{
+  GIZ_DP_BOOL = 0,                                  ///< Bit field in wBitBuf/rBitBuf
+  GIZ_DP_VALUE,                                     ///< 16-bit big-endian value, y = ratio * x + addition
+} gizDataPointType_t;
+
+/** Report policies for the table: minimum interval (ms), deadband, maximum staleness (ms; 0 = none), settings key of the deadband */
+#define GIZ_REPORT_CHANGE                 0, 0, 0, SETTINGS_KEY_NONE                         ///< Every change at once
+#define GIZ_REPORT_ANALOG(deadband, key)  REPORT_TIME_MAX, deadband, REPORT_STALE_MAX, key   ///< Noisy measurement, deadband settable
+
+#define GIZ_DEADBAND_PERCENT 0x8000                 ///< Deadband setting in 0.1 % of the last reported value, at least one LSB
+#define GIZ_DEADBAND_DEFAULT 0xFFFF                 ///< Deadband setting that means the table value
+
+#define GIZ_DP_READ_ONLY    0xFF                    ///< flag of a data point the cloud cannot write
+
+/**@name Compact report over the passthrough channel, see gizCompactEncode and Tools/compactreport.py
+* @{
+*/
+#define GIZ_COMPACT_KEY     0x40                    ///< frame type in the top two bits of byte 0: every field, values absolute
+#define GIZ_COMPACT_DELTA   0x80                    ///< changed fields only, values as zigzag deltas
+#define GIZ_COMPACT_REPLAY  0xC0                    ///< a report from the backlog: its age, then every field as in a keyframe
+#define GIZ_COMPACT_SEQ     0x3F                    ///< sequence number in the low six bits, a gap means wait for a keyframe
+#define GIZ_COMPACT_MAX     (MAX_PACKAGE_LEN - 10)  ///< largest payload gizwitsPassthroughData can frame
+/**@} */
+
+typedef struct
+{
+  const char *name;                                 ///< For the log
+  uint8_t type;                                     ///< gizDataPointType_t
+  uint8_t point;                                    ///< Offset in dataPoint_t
+  uint8_t width;                                    ///< Size in dataPoint_t
+  uint8_t status;                                   ///< Byte offset of the bits, or offset of the value, in devStatus_t
+  uint8_t bitOffset;                                ///< GIZ_DP_BOOL only
+  uint8_t bitLen;                                   ///< GIZ_DP_BOOL only
+  uint8_t flag;                                     ///< Bit in attrFlags_t, GIZ_DP_READ_ONLY for sensors
+  uint8_t issued;                                   ///< Offset of a writable value in attrVals_t
+  uint8_t event;                                    ///< EVENT_TYPE_T raised when the cloud writes it
+  uint32_t minInterval;                             ///< A significant change waits this long after the last report of the field
+  uint16_t deadband;                                ///< Smaller changes are not significant
+  uint32_t maxStale;                                ///< ...but are reported once the field is this old
+  uint8_t deadbandKey;                              ///< Settings key that overrides deadband, SETTINGS_KEY_NONE if fixed
+  uint16_t ratio;
+  int16_t addition;
+  uint16_t min;
+  uint16_t max;
+} gizDataPoint_t;
+
 /**@name Gizwits user API interface
 * @{
 */
 
 extern uint32_t gizGetTimerCount(void);
+extern rb_t pRb;
 
 void gizwitsInit(void);
 int32_t gizwitsSetMode(uint8_t mode);
 void gizwitsGetNTP(void);
 int32_t gizwitsHandle(dataPoint_t *currentData);
 int32_t gizwitsPassthroughData(uint8_t * gizdata, uint32_t len);
+int8_t gizwitsInputRegister(uint16_t addr, uint16_t *value);
 void gizwitsGetModuleInfo(void);
 int32_t gizPutData(uint8_t *buf, uint32_t len);
 
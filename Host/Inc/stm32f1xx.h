@@ -0,0 +1,6 @@
+#ifndef __HOST_STM32F1XX_H
+#define __HOST_STM32F1XX_H
+
+#include "stm32f1xx_hal.h"
+
+#endif /* __HOST_STM32F1XX_H */
@@ -0,0 +1,384 @@
+#ifndef __HOST_STM32F1XX_HAL_H
+#define __HOST_STM32F1XX_HAL_H
+
+/*
+ * Stand-in for the STM32F1 HAL when the firmware is built for Linux (see
+ * Host/Makefile). Only the types, macros and functions the project uses are
+ * provided. Register blocks are plain structs in RAM; Host/Src/hostHal.c
+ * plays the peripherals against them and calls the real interrupt handlers
+ * from a 1 ms signal.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define __IO volatile
+#define __weak __attribute__((weak))
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef enum { RESET = 0, SET = !RESET } FlagStatus, ITStatus;
+typedef enum { DISABLE = 0, ENABLE = !DISABLE } FunctionalState;
+
+#define SET_BIT(REG, BIT)		((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT)		((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT)		((REG) & (BIT))
+#define UNUSED(x)				((void)(x))
+
+/* Interrupt numbers ---------------------------------------------------------*/
+typedef enum
+{
+	MemoryManagement_IRQn = -12,
+	BusFault_IRQn = -11,
+	UsageFault_IRQn = -10,
+	SVCall_IRQn = -5,
+	DebugMonitor_IRQn = -4,
+	PendSV_IRQn = -2,
+	SysTick_IRQn = -1,
+	DMA1_Channel1_IRQn = 11,
+	DMA1_Channel2_IRQn = 12,
+	DMA1_Channel3_IRQn = 13,
+	DMA1_Channel4_IRQn = 14,
+	DMA1_Channel5_IRQn = 15,
+	DMA1_Channel6_IRQn = 16,
+	DMA1_Channel7_IRQn = 17,
+	TIM3_IRQn = 29,
+	TIM4_IRQn = 30,
+	USART1_IRQn = 37,
+	USART2_IRQn = 38,
+	USART3_IRQn = 39
+} IRQn_Type;
+
+#define NVIC_PRIORITYGROUP_4	0x00000003U
+
+/* Register blocks -----------------------------------------------------------*/
+typedef struct { __IO uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR; } USART_TypeDef;
+typedef struct { __IO uint32_t CCR, CNDTR, CPAR, CMAR; uint32_t hostLen, hostFlags; } DMA_Channel_TypeDef;
+typedef struct { __IO uint32_t CRL, CRH, IDR, ODR, BSRR, BRR, LCKR; } GPIO_TypeDef;
+typedef struct { __IO uint32_t CR1, CR2, SMCR, DIER, SR; } TIM_TypeDef;
+typedef struct { __IO uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { __IO uint32_t DHCSR, DCRSR, DCRDR, DEMCR; } CoreDebug_Type;
+
+extern USART_TypeDef hostUSART1, hostUSART2, hostUSART3;
+extern DMA_Channel_TypeDef hostDMA1_Channel[7];
+extern GPIO_TypeDef hostGPIOA, hostGPIOB, hostGPIOC, hostGPIOD;
+extern TIM_TypeDef hostTIM3, hostTIM4;
+extern CoreDebug_Type hostCoreDebug;
+DWT_Type *hostDwt(void);
+
+#define USART1			(&hostUSART1)
+#define USART2			(&hostUSART2)
+#define USART3			(&hostUSART3)
+#define DMA1_Channel1	(&hostDMA1_Channel[0])
+#define DMA1_Channel2	(&hostDMA1_Channel[1])
+#define DMA1_Channel3	(&hostDMA1_Channel[2])
+#define DMA1_Channel4	(&hostDMA1_Channel[3])
+#define DMA1_Channel5	(&hostDMA1_Channel[4])
+#define DMA1_Channel6	(&hostDMA1_Channel[5])
+#define DMA1_Channel7	(&hostDMA1_Channel[6])
+#define GPIOA			(&hostGPIOA)
+#define GPIOB			(&hostGPIOB)
+#define GPIOC			(&hostGPIOC)
+#define GPIOD			(&hostGPIOD)
+#define TIM3			(&hostTIM3)
+#define TIM4			(&hostTIM4)
+#define DWT				(hostDwt())			//CYCCNT follows the host clock scaled to 72 MHz
+#define CoreDebug		(&hostCoreDebug)
+
+#define FLASH_BASE		0x08000000U			//mapped at the same address by the host build
+#define FLASH_PAGE_SIZE	0x400U
+
+#define DWT_CTRL_CYCCNTENA_Msk		(1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk	(1UL << 24)
+
+#define USART_SR_PE			0x0001U
+#define USART_SR_FE			0x0002U
+#define USART_SR_NE			0x0004U
+#define USART_SR_ORE		0x0008U
+#define USART_SR_IDLE		0x0010U
+#define USART_SR_RXNE		0x0020U
+#define USART_SR_TC			0x0040U
+#define USART_SR_TXE		0x0080U
+#define USART_CR1_IDLEIE	0x0010U
+#define USART_CR1_RXNEIE	0x0020U
+#define USART_CR1_TCIE		0x0040U
+#define USART_CR1_TXEIE		0x0080U
+#define USART_CR1_PEIE		0x0100U
+#define USART_CR3_EIE		0x0001U
+#define USART_CR3_DMAR		0x0040U
+#define USART_CR3_DMAT		0x0080U
+
+#define DMA_CCR_EN			0x0001U
+#define DMA_CCR_TCIE		0x0002U
+#define DMA_CCR_HTIE		0x0004U
+#define DMA_CCR_TEIE		0x0008U
+#define DMA_CCR_CIRC		0x0020U
+
+#define TIM_CR1_CEN			0x0001U
+#define TIM_DIER_UIE		0x0001U
+
+/* Core ----------------------------------------------------------------------*/
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+void __set_FAULTMASK(uint32_t faultMask);
+void __WFI(void);
+#define __DMB()		__sync_synchronize()
+#define __DSB()		__sync_synchronize()
+#define __ISB()		__sync_synchronize()
+#define __NOP()		((void)0)
+void NVIC_SystemReset(void) __attribute__((noreturn));
+
+/* HAL core, RCC and NVIC ----------------------------------------------------*/
+HAL_StatusTypeDef HAL_Init(void);
+void HAL_MspInit(void);
+void HAL_IncTick(void);
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+uint32_t HAL_SYSTICK_Config(uint32_t TicksNumb);
+void HAL_SYSTICK_CLKSourceConfig(uint32_t CLKSource);
+void HAL_SYSTICK_IRQHandler(void);
+void HAL_SYSTICK_Callback(void);
+void HAL_NVIC_SetPriorityGrouping(uint32_t PriorityGroup);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+#define SYSTICK_CLKSOURCE_HCLK	0x00000004U
+
+typedef struct { uint32_t PLLState, PLLSource, PLLMUL; } RCC_PLLInitTypeDef;
+typedef struct
+{
+	uint32_t OscillatorType, HSEState, HSEPredivValue, LSEState, HSIState, HSICalibrationValue, LSIState;
+	RCC_PLLInitTypeDef PLL;
+} RCC_OscInitTypeDef;
+typedef struct { uint32_t ClockType, SYSCLKSource, AHBCLKDivider, APB1CLKDivider, APB2CLKDivider; } RCC_ClkInitTypeDef;
+
+#define RCC_OSCILLATORTYPE_HSE	0x00000001U
+#define RCC_HSE_ON				0x00010000U
+#define RCC_HSE_PREDIV_DIV1		0x00000000U
+#define RCC_HSI_ON				0x00000001U
+#define RCC_PLL_ON				0x00000002U
+#define RCC_PLLSOURCE_HSE		0x00010000U
+#define RCC_PLL_MUL9			0x001C0000U
+#define RCC_CLOCKTYPE_SYSCLK	0x00000001U
+#define RCC_CLOCKTYPE_HCLK		0x00000002U
+#define RCC_CLOCKTYPE_PCLK1		0x00000004U
+#define RCC_CLOCKTYPE_PCLK2		0x00000008U
+#define RCC_SYSCLKSOURCE_PLLCLK	0x00000002U
+#define RCC_SYSCLK_DIV1			0x00000000U
+#define RCC_HCLK_DIV1			0x00000000U
+#define RCC_HCLK_DIV2			0x00000400U
+#define FLASH_LATENCY_2			0x00000002U
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct);
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency);
+uint32_t HAL_RCC_GetHCLKFreq(void);
+
+#define __HAL_RCC_AFIO_CLK_ENABLE()		((void)0)
+#define __HAL_RCC_GPIOA_CLK_ENABLE()	((void)0)
+#define __HAL_RCC_GPIOB_CLK_ENABLE()	((void)0)
+#define __HAL_RCC_GPIOC_CLK_ENABLE()	((void)0)
+#define __HAL_RCC_GPIOD_CLK_ENABLE()	((void)0)
+#define __HAL_RCC_DMA1_CLK_ENABLE()		((void)0)
+#define __HAL_RCC_TIM3_CLK_ENABLE()		((void)0)
+#define __HAL_RCC_TIM3_CLK_DISABLE()	((void)0)
+#define __HAL_RCC_TIM4_CLK_ENABLE()		((void)0)
+#define __HAL_RCC_TIM4_CLK_DISABLE()	((void)0)
+#define __HAL_RCC_USART1_CLK_ENABLE()	((void)0)
+#define __HAL_RCC_USART1_CLK_DISABLE()	((void)0)
+#define __HAL_RCC_USART2_CLK_ENABLE()	((void)0)
+#define __HAL_RCC_USART2_CLK_DISABLE()	((void)0)
+#define __HAL_RCC_USART3_CLK_ENABLE()	((void)0)
+#define __HAL_RCC_USART3_CLK_DISABLE()	((void)0)
+#define __HAL_AFIO_REMAP_SWJ_DISABLE()	((void)0)
+
+/* GPIO ----------------------------------------------------------------------*/
+typedef struct { uint32_t Pin, Mode, Pull, Speed; } GPIO_InitTypeDef;
+typedef enum { GPIO_PIN_RESET = 0, GPIO_PIN_SET } GPIO_PinState;
+
+#define GPIO_PIN_0				0x0001U
+#define GPIO_PIN_1				0x0002U
+#define GPIO_PIN_2				0x0004U
+#define GPIO_PIN_3				0x0008U
+#define GPIO_PIN_4				0x0010U
+#define GPIO_PIN_5				0x0020U
+#define GPIO_PIN_6				0x0040U
+#define GPIO_PIN_7				0x0080U
+#define GPIO_PIN_8				0x0100U
+#define GPIO_PIN_9				0x0200U
+#define GPIO_PIN_10				0x0400U
+#define GPIO_PIN_11				0x0800U
+#define GPIO_PIN_12				0x1000U
+#define GPIO_PIN_13				0x2000U
+#define GPIO_PIN_14				0x4000U
+#define GPIO_PIN_15				0x8000U
+#define GPIO_MODE_INPUT			0x00000000U
+#define GPIO_MODE_OUTPUT_PP		0x00000001U
+#define GPIO_MODE_AF_PP			0x00000002U
+#define GPIO_MODE_AF_INPUT		GPIO_MODE_INPUT
+#define GPIO_NOPULL				0x00000000U
+#define GPIO_PULLUP				0x00000001U
+#define GPIO_PULLDOWN			0x00000002U
+#define GPIO_SPEED_FREQ_LOW		0x00000002U
+#define GPIO_SPEED_FREQ_MEDIUM	0x00000001U
+#define GPIO_SPEED_FREQ_HIGH	0x00000003U
+
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init);
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+/* DMA -----------------------------------------------------------------------*/
+#define DMA_PERIPH_TO_MEMORY	0x00000000U
+#define DMA_MEMORY_TO_PERIPH	0x00000010U
+#define DMA_PINC_ENABLE			0x00000040U
+#define DMA_PINC_DISABLE		0x00000000U
+#define DMA_MINC_ENABLE			0x00000080U
+#define DMA_MINC_DISABLE		0x00000000U
+#define DMA_PDATAALIGN_BYTE		0x00000000U
+#define DMA_MDATAALIGN_BYTE		0x00000000U
+#define DMA_NORMAL				0x00000000U
+#define DMA_CIRCULAR			DMA_CCR_CIRC
+#define DMA_PRIORITY_LOW		0x00000000U
+#define DMA_PRIORITY_MEDIUM		0x00001000U
+#define DMA_PRIORITY_HIGH		0x00002000U
+#define DMA_PRIORITY_VERY_HIGH	0x00003000U
+#define DMA_IT_TC				DMA_CCR_TCIE
+#define DMA_IT_HT				DMA_CCR_HTIE
+#define DMA_IT_TE				DMA_CCR_TEIE
+
+typedef struct { uint32_t Direction, PeriphInc, MemInc, PeriphDataAlignment, MemDataAlignment, Mode, Priority; } DMA_InitTypeDef;
+typedef enum { HAL_DMA_STATE_RESET = 0, HAL_DMA_STATE_READY, HAL_DMA_STATE_BUSY, HAL_DMA_STATE_TIMEOUT } HAL_DMA_StateTypeDef;
+
+typedef struct __DMA_HandleTypeDef
+{
+	DMA_Channel_TypeDef *Instance;
+	DMA_InitTypeDef Init;
+	HAL_DMA_StateTypeDef State;
+	void *Parent;
+	void (*XferCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+	void (*XferHalfCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+	void (*XferErrorCallback)(struct __DMA_HandleTypeDef *hdma);
+	void (*XferAbortCallback)(struct __DMA_HandleTypeDef *hdma);
+	__IO uint32_t ErrorCode;
+} DMA_HandleTypeDef;
+
+#define __HAL_LINKDMA(__HANDLE__, __PPP_DMA_FIELD__, __DMA_HANDLE__)	\
+	do { (__HANDLE__)->__PPP_DMA_FIELD__ = &(__DMA_HANDLE__); (__DMA_HANDLE__).Parent = (__HANDLE__); } while (0)
+#define __HAL_DMA_GET_COUNTER(__HANDLE__)			((__HANDLE__)->Instance->CNDTR)
+#define __HAL_DMA_ENABLE(__HANDLE__)				SET_BIT((__HANDLE__)->Instance->CCR, DMA_CCR_EN)
+#define __HAL_DMA_DISABLE(__HANDLE__)				CLEAR_BIT((__HANDLE__)->Instance->CCR, DMA_CCR_EN)
+#define __HAL_DMA_ENABLE_IT(__HANDLE__, __IT__)		SET_BIT((__HANDLE__)->Instance->CCR, (__IT__))
+#define __HAL_DMA_DISABLE_IT(__HANDLE__, __IT__)	CLEAR_BIT((__HANDLE__)->Instance->CCR, (__IT__))
+
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma);
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength);
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength);
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma);
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma);
+
+/* UART ----------------------------------------------------------------------*/
+typedef struct { uint32_t BaudRate, WordLength, StopBits, Parity, Mode, HwFlowCtl, OverSampling; } UART_InitTypeDef;
+
+typedef enum
+{
+	HAL_UART_STATE_RESET = 0x00U,
+	HAL_UART_STATE_READY = 0x20U,
+	HAL_UART_STATE_BUSY = 0x24U,
+	HAL_UART_STATE_BUSY_TX = 0x21U,
+	HAL_UART_STATE_BUSY_RX = 0x22U
+} HAL_UART_StateTypeDef;
+
+typedef struct __UART_HandleTypeDef
+{
+	USART_TypeDef *Instance;
+	UART_InitTypeDef Init;
+	uint8_t *pTxBuffPtr;
+	uint16_t TxXferSize;
+	__IO uint16_t TxXferCount;
+	DMA_HandleTypeDef *hdmatx;
+	DMA_HandleTypeDef *hdmarx;
+	__IO HAL_UART_StateTypeDef gState;
+	__IO HAL_UART_StateTypeDef RxState;
+	__IO uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+#define UART_WORDLENGTH_8B		0x00000000U
+#define UART_STOPBITS_1			0x00000000U
+#define UART_PARITY_NONE		0x00000000U
+#define UART_MODE_TX_RX			0x0000000CU
+#define UART_HWCONTROL_NONE		0x00000000U
+#define UART_OVERSAMPLING_16	0x00000000U
+
+#define UART_FLAG_PE			USART_SR_PE
+#define UART_FLAG_FE			USART_SR_FE
+#define UART_FLAG_NE			USART_SR_NE
+#define UART_FLAG_ORE			USART_SR_ORE
+#define UART_FLAG_IDLE			USART_SR_IDLE
+#define UART_FLAG_RXNE			USART_SR_RXNE
+#define UART_FLAG_TC			USART_SR_TC
+#define UART_FLAG_TXE			USART_SR_TXE
+#define UART_IT_IDLE			USART_CR1_IDLEIE	//all CR1 bits here, unlike the real encoding
+#define UART_IT_RXNE			USART_CR1_RXNEIE
+#define UART_IT_TC				USART_CR1_TCIE
+#define UART_IT_TXE				USART_CR1_TXEIE
+
+#define __HAL_UART_GET_FLAG(__HANDLE__, __FLAG__)		((((__HANDLE__)->Instance->SR) & (__FLAG__)) == (__FLAG__))
+#define __HAL_UART_CLEAR_FLAG(__HANDLE__, __FLAG__)		((__HANDLE__)->Instance->SR = ~(__FLAG__))
+#define __HAL_UART_CLEAR_PEFLAG(__HANDLE__)				do { (void)(__HANDLE__)->Instance->SR; (void)(__HANDLE__)->Instance->DR; } while (0)
+#define __HAL_UART_CLEAR_IDLEFLAG(__HANDLE__)			__HAL_UART_CLEAR_PEFLAG(__HANDLE__)
+#define __HAL_UART_CLEAR_OREFLAG(__HANDLE__)			__HAL_UART_CLEAR_PEFLAG(__HANDLE__)
+#define __HAL_UART_ENABLE_IT(__HANDLE__, __IT__)		SET_BIT((__HANDLE__)->Instance->CR1, (__IT__))
+#define __HAL_UART_DISABLE_IT(__HANDLE__, __IT__)		CLEAR_BIT((__HANDLE__)->Instance->CR1, (__IT__))
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart);
+void HAL_UART_MspInit(UART_HandleTypeDef *huart);
+void HAL_UART_MspDeInit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size);
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart);
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart);
+
+/* TIM -----------------------------------------------------------------------*/
+typedef struct { uint32_t Prescaler, CounterMode, Period, ClockDivision, RepetitionCounter, AutoReloadPreload; } TIM_Base_InitTypeDef;
+typedef struct { TIM_TypeDef *Instance; TIM_Base_InitTypeDef Init; } TIM_HandleTypeDef;
+typedef struct { uint32_t ClockSource, ClockPolarity, ClockPrescaler, ClockFilter; } TIM_ClockConfigTypeDef;
+typedef struct { uint32_t MasterOutputTrigger, MasterSlaveMode; } TIM_MasterConfigTypeDef;
+
+#define TIM_COUNTERMODE_UP					0x00000000U
+#define TIM_CLOCKDIVISION_DIV1				0x00000000U
+#define TIM_AUTORELOAD_PRELOAD_DISABLE		0x00000000U
+#define TIM_CLOCKSOURCE_INTERNAL			0x00001000U
+#define TIM_TRGO_RESET						0x00000000U
+#define TIM_MASTERSLAVEMODE_DISABLE			0x00000000U
+
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim);
+void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim);
+void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *sClockSourceConfig);
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, TIM_MasterConfigTypeDef *sMasterConfig);
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim);
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim);
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef *htim);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
+
+/* FLASH ---------------------------------------------------------------------*/
+typedef struct { uint32_t TypeErase, Banks, PageAddress, NbPages; } FLASH_EraseInitTypeDef;
+
+#define FLASH_TYPEERASE_PAGES			0x00U
+#define FLASH_TYPEERASE_MASSERASE		0x02U
+#define FLASH_TYPEPROGRAM_HALFWORD		0x01U
+#define FLASH_TYPEPROGRAM_WORD			0x02U
+#define FLASH_TYPEPROGRAM_DOUBLEWORD	0x03U
+#define FLASH_BANK_1					1U
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError);
+
+#endif /* __HOST_STM32F1XX_HAL_H */
@@ -0,0 +1,845 @@
+/*
+ * Peripherals of the host build (see Host/Makefile).
+ *
+ * The firmware runs unchanged as a single Linux process. A 1 ms SIGALRM is
+ * the interrupt line: its handler advances the tick, calls SysTick_Handler
+ * and the timer handlers, moves received bytes into the DMA buffers and calls
+ * the DMA, IDLE and TC handlers the way the hardware would. PRIMASK blocks
+ * the signal, __WFI waits for it.
+ *
+ * USART1 (Modbus) and USART2 (GAgent) are pseudo terminals; their slave side
+ * is linked to a fixed path for the Modbus master and the fake GAgent.
+ * USART3 (debug) goes to stdout. Bytes move at the configured baud rate
+ * unless HOST_FAST_UART=1.
+ *
+ * The flash is a 64 KB file mapped at FLASH_BASE, so pointers into flash work
+ * as on target and the settings survive a restart. NVIC_SystemReset execs
+ * the process again and keeps the serial ports open.
+ *
+ * Environment:
+ *   HOST_FLASH       flash image, default flash.bin
+ *   HOST_USART1_PTY  link to the Modbus port, default /tmp/gprs-modbus
+ *   HOST_USART2_PTY  link to the GAgent port, default /tmp/gprs-gagent
+ *   HOST_USART1_FD   use this open descriptor for USART1 instead of a pty
+ *   HOST_USART2_FD   same for USART2
+ *   HOST_FAST_UART   1: no baud rate limit on USART1/USART2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#undef CR1									//termios output delay flags, not the register names
+#undef CR2
+#undef CR3
+#include "stm32f1xx_hal.h"
+
+#define HOST_FLASH_SIZE		(64 * 1024)
+#define HOST_MAX_CATCHUP	50				//ticks delivered by one signal after the process was descheduled
+
+USART_TypeDef hostUSART1, hostUSART2, hostUSART3;
+DMA_Channel_TypeDef hostDMA1_Channel[7];
+GPIO_TypeDef hostGPIOA, hostGPIOB, hostGPIOC, hostGPIOD;
+TIM_TypeDef hostTIM3, hostTIM4;
+CoreDebug_Type hostCoreDebug;
+static DWT_Type hostDwtRegs;
+
+/* Handlers of the firmware, weak so a missing one is simply not called */
+extern void SysTick_Handler(void) __attribute__((weak));
+extern void TIM3_IRQHandler(void) __attribute__((weak));
+extern void TIM4_IRQHandler(void) __attribute__((weak));
+extern void USART1_IRQHandler(void) __attribute__((weak));
+extern void USART2_IRQHandler(void) __attribute__((weak));
+extern void USART3_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel1_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel2_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel3_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel4_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel5_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel6_IRQHandler(void) __attribute__((weak));
+extern void DMA1_Channel7_IRQHandler(void) __attribute__((weak));
+
+static void (*const hostDmaIrq[7])(void) = {
+	DMA1_Channel1_IRQHandler, DMA1_Channel2_IRQHandler, DMA1_Channel3_IRQHandler, DMA1_Channel4_IRQHandler,
+	DMA1_Channel5_IRQHandler, DMA1_Channel6_IRQHandler, DMA1_Channel7_IRQHandler
+};
+
+typedef struct {
+	USART_TypeDef *regs;
+	DMA_Channel_TypeDef *rxDma;				//channel wired to RX on the F103
+	const char *name;
+	const char *linkEnv;
+	const char *linkDefault;
+	const char *fdEnv;
+	UART_HandleTypeDef *handle;				//set by HAL_UART_Init
+	int fd;
+	uint8_t rxActive;						//bytes arrived since the last IDLE
+	uint8_t txBusy;
+	uint32_t txDoneTick;
+	uint32_t rxBytes;
+	uint32_t txBytes;
+} hostUart_t;
+
+static hostUart_t hostUart[3] = {
+	{ &hostUSART1, &hostDMA1_Channel[4], "USART1", "HOST_USART1_PTY", "/tmp/gprs-modbus", "HOST_USART1_FD" },
+	{ &hostUSART2, &hostDMA1_Channel[5], "USART2", "HOST_USART2_PTY", "/tmp/gprs-gagent", "HOST_USART2_FD" },
+	{ &hostUSART3, &hostDMA1_Channel[2], "USART3", NULL, NULL, NULL },
+};
+
+static char **hostArgv;
+static uint8_t *hostFlash;
+static uint8_t hostFlashLocked = 1;
+static uint32_t hostFlashErases = 0;
+static uint32_t hostFlashWrites = 0;
+static uint8_t hostFastUart = 0;
+
+static volatile uint32_t hostPrimask = 0;
+static volatile uint8_t hostInIsr = 0;
+static volatile uint32_t uwTick = 0;
+static uint32_t hostTicks = 0;				//milliseconds delivered so far
+static uint64_t hostStartNs = 0;
+static uint32_t hostTimUs[2];				//TIM3/TIM4 time since the last update event
+static uint8_t hostTickStarted = 0;
+
+static uint64_t hostNowNs(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+DWT_Type *hostDwt(void) {
+	hostDwtRegs.CYCCNT = (uint32_t)(hostNowNs() * 9 / 125);		//72 cycles per microsecond
+	return &hostDwtRegs;
+}
+
+static hostUart_t *hostUartOf(USART_TypeDef *regs) {
+	uint8_t i;
+
+	for (i = 0; i < 3; i++) {
+		if (hostUart[i].regs == regs) {
+			return &hostUart[i];
+		}
+	}
+	return NULL;
+}
+
+/* Core ----------------------------------------------------------------------*/
+static void hostMaskTick(int block) {
+	sigset_t set;
+
+	if (hostInIsr) {
+		return;								//the handler already runs with the signal blocked
+	}
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigprocmask(block ? SIG_BLOCK : SIG_UNBLOCK, &set, NULL);
+}
+
+void __disable_irq(void) {
+	hostPrimask = 1;
+	hostMaskTick(1);
+}
+
+void __enable_irq(void) {
+	hostPrimask = 0;
+	hostMaskTick(0);
+}
+
+uint32_t __get_PRIMASK(void) {
+	return hostPrimask;
+}
+
+void __set_PRIMASK(uint32_t priMask) {
+	if (priMask) {
+		__disable_irq();
+	} else {
+		__enable_irq();
+	}
+}
+
+void __set_FAULTMASK(uint32_t faultMask) {
+	__set_PRIMASK(faultMask);
+}
+
+/* Sleeps until the next tick; with PRIMASK set the handler still runs, as the wake-up would on target */
+void __WFI(void) {
+	sigset_t set;
+
+	if (hostInIsr) {
+		return;
+	}
+	sigprocmask(SIG_BLOCK, NULL, &set);
+	sigdelset(&set, SIGALRM);
+	sigsuspend(&set);
+}
+
+static void hostStats(void) {
+	fprintf(stderr, "host: %u ms, flash %u erases %u writes, USART1 rx %u tx %u, USART2 rx %u tx %u\n",
+		hostTicks, hostFlashErases, hostFlashWrites,
+		hostUart[0].rxBytes, hostUart[0].txBytes, hostUart[1].rxBytes, hostUart[1].txBytes);
+}
+
+void NVIC_SystemReset(void) {
+	struct itimerval off;
+
+	memset(&off, 0, sizeof(off));
+	setitimer(ITIMER_REAL, &off, NULL);		//an interval timer survives exec
+	fflush(stdout);
+	fprintf(stderr, "host: system reset\n");
+	hostStats();
+	msync(hostFlash, HOST_FLASH_SIZE, MS_SYNC);
+	execv("/proc/self/exe", hostArgv);
+	perror("host: execv");
+	_exit(1);
+}
+
+/* Serial ports --------------------------------------------------------------*/
+static void hostDmaEvent(uint8_t ch, uint32_t flag) {
+	DMA_Channel_TypeDef *dma = &hostDMA1_Channel[ch];
+
+	dma->hostFlags |= flag;
+	if ((dma->CCR & flag) && hostDmaIrq[ch]) {
+		hostDmaIrq[ch]();
+	}
+}
+
+/* Peripheral to memory, one byte as the DMA request of RXNE would move it */
+static void hostDmaWrite(DMA_Channel_TypeDef *dma, uint8_t data) {
+	uint8_t ch = dma - hostDMA1_Channel;
+
+	*(uint8_t *)(uintptr_t)(dma->CMAR + (dma->hostLen - dma->CNDTR)) = data;
+	dma->CNDTR--;
+	if (dma->CNDTR == dma->hostLen / 2) {
+		hostDmaEvent(ch, DMA_CCR_HTIE);
+	}
+	if (dma->CNDTR == 0) {
+		if (dma->CCR & DMA_CCR_CIRC) {
+			dma->CNDTR = dma->hostLen;
+		} else {
+			dma->CCR &= ~DMA_CCR_EN;
+		}
+		hostDmaEvent(ch, DMA_CCR_TCIE);
+	}
+}
+
+static void hostUartIrq(hostUart_t *uart) {
+	if (uart->regs == USART1 && USART1_IRQHandler) {
+		USART1_IRQHandler();
+	} else if (uart->regs == USART2 && USART2_IRQHandler) {
+		USART2_IRQHandler();
+	} else if (uart->regs == USART3 && USART3_IRQHandler) {
+		USART3_IRQHandler();
+	}
+}
+
+/* Bytes that take this many milliseconds on the wire at the configured baud rate */
+static uint32_t hostWireMs(hostUart_t *uart, uint32_t len) {
+	uint32_t baud = uart->handle ? uart->handle->Init.BaudRate : 0;
+
+	if (hostFastUart || baud == 0) {
+		return 1;
+	}
+	return (len * 10000 + baud - 1) / baud;
+}
+
+static void hostUartService(hostUart_t *uart, uint32_t ms) {
+	uint8_t buf[4096];
+	uint32_t budget;
+	uint32_t baud;
+	ssize_t n;
+	ssize_t i;
+
+	if (uart->txBusy && (int32_t)(hostTicks - uart->txDoneTick) >= 0) {
+		uart->txBusy = 0;
+		uart->regs->SR |= USART_SR_TC | USART_SR_TXE;
+		if (uart->regs->CR1 & USART_CR1_TCIE) {
+			hostUartIrq(uart);
+		}
+	}
+
+	if (uart->fd < 0 || !(uart->regs->CR3 & USART_CR3_DMAR) || !(uart->rxDma->CCR & DMA_CCR_EN)) {
+		return;								//not receiving yet, bytes wait in the pty
+	}
+	baud = uart->handle ? uart->handle->Init.BaudRate : 0;
+	budget = (hostFastUart || baud == 0) ? sizeof(buf) : (baud * ms + 9999) / 10000;
+	if (budget > sizeof(buf)) {
+		budget = sizeof(buf);
+	}
+	n = read(uart->fd, buf, budget);
+	if (n > 0) {
+		uart->rxBytes += n;
+		uart->rxActive = 1;
+		for (i = 0; i < n && (uart->rxDma->CCR & DMA_CCR_EN); i++) {
+			hostDmaWrite(uart->rxDma, buf[i]);
+		}
+	}
+	if ((n <= 0 || (uint32_t)n < budget) && uart->rxActive) {
+		uart->rxActive = 0;					//line went quiet
+		uart->regs->SR |= USART_SR_IDLE;
+		if (uart->regs->CR1 & USART_CR1_IDLEIE) {
+			hostUartIrq(uart);
+		}
+		uart->regs->SR &= ~USART_SR_IDLE;
+	}
+}
+
+static int hostUartOpen(hostUart_t *uart) {
+	const char *env = getenv(uart->fdEnv);
+	const char *link;
+	struct termios tio;
+	char value[16];
+	int fd;
+	int slave;
+
+	if (env) {
+		fd = atoi(env);						//kept across NVIC_SystemReset, or handed over by a test driver
+	} else {
+		fd = posix_openpt(O_RDWR | O_NOCTTY);
+		if (fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+			perror("host: pty");
+			return -1;
+		}
+		slave = open(ptsname(fd), O_RDWR | O_NOCTTY);		//held open so the master never sees a hangup
+		if (slave >= 0 && tcgetattr(slave, &tio) == 0) {
+			cfmakeraw(&tio);
+			tcsetattr(slave, TCSANOW, &tio);
+		}
+		link = getenv(uart->linkEnv) ? getenv(uart->linkEnv) : uart->linkDefault;
+		unlink(link);
+		if (symlink(ptsname(fd), link) < 0) {
+			perror("host: symlink");
+		}
+		fprintf(stderr, "host: %s on %s (%s)\n", uart->name, link, ptsname(fd));
+		snprintf(value, sizeof(value), "%d", fd);
+		setenv(uart->fdEnv, value, 1);
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+static void hostWrite(int fd, const uint8_t *buf, uint16_t len) {
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) {
+				continue;
+			}
+			return;							//nobody reading, the bytes are lost on the wire
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+/* The interrupt line --------------------------------------------------------*/
+static void hostTimerTick(TIM_TypeDef *tim, uint32_t *us, void (*irq)(void)) {
+	uint32_t periodUs;
+
+	if (!(tim->CR1 & TIM_CR1_CEN)) {
+		return;
+	}
+	periodUs = tim->CR2;					//stored by HAL_TIM_Base_Init
+	*us += 1000;
+	while (periodUs && *us >= periodUs) {
+		*us -= periodUs;
+		tim->SR |= 1;
+		if ((tim->DIER & TIM_DIER_UIE) && irq) {
+			irq();
+		}
+	}
+}
+
+static void hostInterrupt(int sig) {
+	uint32_t due = (uint32_t)((hostNowNs() - hostStartNs) / 1000000);
+	uint32_t ms = 0;
+	int savedErrno = errno;
+	uint8_t i;
+
+	(void)sig;
+	hostInIsr = 1;
+	while ((int32_t)(due - hostTicks) > 0 && ms < HOST_MAX_CATCHUP) {
+		hostTicks++;
+		ms++;
+		if (SysTick_Handler) {
+			SysTick_Handler();
+		}
+		hostTimerTick(TIM3, &hostTimUs[0], TIM3_IRQHandler);
+		hostTimerTick(TIM4, &hostTimUs[1], TIM4_IRQHandler);
+	}
+	if (ms > 0) {
+		for (i = 0; i < 3; i++) {
+			hostUartService(&hostUart[i], ms);
+		}
+	}
+	hostInIsr = 0;
+	errno = savedErrno;
+}
+
+static void hostQuit(int sig) {
+	(void)sig;
+	fflush(stdout);
+	hostStats();
+	_exit(0);
+}
+
+__attribute__((constructor)) static void hostInit(int argc, char **argv) {
+	struct sigaction sa;
+	sigset_t set;
+	struct stat st;
+	uint8_t i;
+	const char *path;
+	int fd;
+
+	(void)argc;
+	hostArgv = argv;
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	hostFastUart = getenv("HOST_FAST_UART") && atoi(getenv("HOST_FAST_UART"));
+
+	signal(SIGALRM, SIG_IGN);				//drops a tick left pending by a reset
+	sigemptyset(&set);
+	sigaddset(&set, SIGALRM);
+	sigprocmask(SIG_UNBLOCK, &set, NULL);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = hostQuit;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	path = getenv("HOST_FLASH") ? getenv("HOST_FLASH") : "flash.bin";
+	fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror("host: flash image");
+		exit(1);
+	}
+	if (st.st_size < HOST_FLASH_SIZE) {
+		static const uint8_t erased = 0xFF;
+		off_t pos;
+
+		for (pos = st.st_size; pos < HOST_FLASH_SIZE; pos++) {
+			pwrite(fd, &erased, 1, pos);		//a new image starts erased
+		}
+	}
+	hostFlash = mmap((void *)(uintptr_t)FLASH_BASE, HOST_FLASH_SIZE, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+	if (hostFlash != (uint8_t *)(uintptr_t)FLASH_BASE) {
+		perror("host: flash mapping");
+		exit(1);
+	}
+	close(fd);
+
+	for (i = 0; i < 2; i++) {
+		hostUart[i].fd = hostUartOpen(&hostUart[i]);
+	}
+	hostUart[2].fd = STDOUT_FILENO;
+	atexit(hostStats);
+}
+
+/* HAL core, RCC and NVIC ----------------------------------------------------*/
+HAL_StatusTypeDef HAL_Init(void) {
+	struct sigaction sa;
+	struct itimerval tv;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = hostInterrupt;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGALRM, &sa, NULL);
+
+	hostStartNs = hostNowNs();
+	hostTicks = 0;
+	tv.it_interval.tv_sec = 0;
+	tv.it_interval.tv_usec = 1000;
+	tv.it_value = tv.it_interval;
+	setitimer(ITIMER_REAL, &tv, NULL);
+	hostTickStarted = 1;
+
+	HAL_MspInit();
+	return HAL_OK;
+}
+
+__weak void HAL_MspInit(void) {
+}
+
+void HAL_IncTick(void) {
+	uwTick++;
+}
+
+uint32_t HAL_GetTick(void) {
+	return uwTick;
+}
+
+void HAL_Delay(uint32_t Delay) {
+	uint32_t start = HAL_GetTick();
+
+	while (hostTickStarted && (HAL_GetTick() - start) < Delay) {
+		__WFI();
+	}
+}
+
+uint32_t HAL_SYSTICK_Config(uint32_t TicksNumb) {
+	(void)TicksNumb;
+	return 0;
+}
+
+void HAL_SYSTICK_CLKSourceConfig(uint32_t CLKSource) {
+	(void)CLKSource;
+}
+
+void HAL_SYSTICK_IRQHandler(void) {
+	HAL_SYSTICK_Callback();
+}
+
+__weak void HAL_SYSTICK_Callback(void) {
+}
+
+void HAL_NVIC_SetPriorityGrouping(uint32_t PriorityGroup) {
+	(void)PriorityGroup;
+}
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+	(void)IRQn;
+	(void)PreemptPriority;
+	(void)SubPriority;
+}
+
+/* Every interrupt shares the tick signal, so individual lines are always enabled */
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn) {
+	(void)IRQn;
+}
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn) {
+	(void)IRQn;
+}
+
+HAL_StatusTypeDef HAL_RCC_OscConfig(RCC_OscInitTypeDef *RCC_OscInitStruct) {
+	(void)RCC_OscInitStruct;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RCC_ClockConfig(RCC_ClkInitTypeDef *RCC_ClkInitStruct, uint32_t FLatency) {
+	(void)RCC_ClkInitStruct;
+	(void)FLatency;
+	return HAL_OK;
+}
+
+uint32_t HAL_RCC_GetHCLKFreq(void) {
+	return 72000000;
+}
+
+/* GPIO ----------------------------------------------------------------------*/
+void HAL_GPIO_Init(GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init) {
+	if (GPIO_Init->Mode == GPIO_MODE_INPUT && GPIO_Init->Pull == GPIO_PULLUP) {
+		GPIOx->IDR |= GPIO_Init->Pin;		//keys read released
+	}
+}
+
+void HAL_GPIO_DeInit(GPIO_TypeDef *GPIOx, uint32_t GPIO_Pin) {
+	GPIOx->ODR &= ~GPIO_Pin;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+	return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+	if (PinState != GPIO_PIN_RESET) {
+		GPIOx->ODR |= GPIO_Pin;
+	} else {
+		GPIOx->ODR &= ~GPIO_Pin;
+	}
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+	GPIOx->ODR ^= GPIO_Pin;
+}
+
+/* DMA -----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_DMA_Init(DMA_HandleTypeDef *hdma) {
+	if (hdma == NULL) {
+		return HAL_ERROR;
+	}
+	hdma->Instance->CCR = hdma->Init.Direction | hdma->Init.PeriphInc | hdma->Init.MemInc |
+		hdma->Init.PeriphDataAlignment | hdma->Init.MemDataAlignment | hdma->Init.Mode | hdma->Init.Priority;
+	hdma->State = HAL_DMA_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_DeInit(DMA_HandleTypeDef *hdma) {
+	if (hdma == NULL) {
+		return HAL_ERROR;
+	}
+	memset((void *)hdma->Instance, 0, sizeof(*hdma->Instance));
+	hdma->State = HAL_DMA_STATE_RESET;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength) {
+	DMA_Channel_TypeDef *dma = hdma->Instance;
+
+	if (hdma->State != HAL_DMA_STATE_READY) {
+		return HAL_BUSY;
+	}
+	hdma->State = HAL_DMA_STATE_BUSY;
+	dma->CCR &= ~DMA_CCR_EN;
+	dma->CNDTR = DataLength;
+	dma->hostLen = DataLength;
+	dma->hostFlags = 0;
+	if (dma->CCR & DMA_MEMORY_TO_PERIPH) {
+		dma->CPAR = DstAddress;
+		dma->CMAR = SrcAddress;
+	} else {
+		dma->CPAR = SrcAddress;
+		dma->CMAR = DstAddress;
+	}
+	dma->CCR |= DMA_CCR_EN;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_DMA_Start_IT(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength) {
+	HAL_StatusTypeDef status = HAL_DMA_Start(hdma, SrcAddress, DstAddress, DataLength);
+
+	if (status == HAL_OK) {
+		hdma->Instance->CCR |= DMA_CCR_TCIE | DMA_CCR_TEIE;
+		if (hdma->XferHalfCpltCallback) {
+			hdma->Instance->CCR |= DMA_CCR_HTIE;
+		}
+	}
+	return status;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma) {
+	hdma->Instance->CCR &= ~(DMA_CCR_EN | DMA_CCR_TCIE | DMA_CCR_HTIE | DMA_CCR_TEIE);
+	hdma->State = HAL_DMA_STATE_READY;
+	return HAL_OK;
+}
+
+void HAL_DMA_IRQHandler(DMA_HandleTypeDef *hdma) {
+	DMA_Channel_TypeDef *dma = hdma->Instance;
+
+	if ((dma->hostFlags & DMA_CCR_HTIE) && (dma->CCR & DMA_CCR_HTIE)) {
+		dma->hostFlags &= ~DMA_CCR_HTIE;
+		if (!(dma->CCR & DMA_CCR_CIRC)) {
+			dma->CCR &= ~DMA_CCR_HTIE;
+		}
+		if (hdma->XferHalfCpltCallback) {
+			hdma->XferHalfCpltCallback(hdma);
+		}
+	}
+	if ((dma->hostFlags & DMA_CCR_TCIE) && (dma->CCR & DMA_CCR_TCIE)) {
+		dma->hostFlags &= ~DMA_CCR_TCIE;
+		if (!(dma->CCR & DMA_CCR_CIRC)) {
+			dma->CCR &= ~(DMA_CCR_TCIE | DMA_CCR_TEIE);
+			hdma->State = HAL_DMA_STATE_READY;
+		}
+		if (hdma->XferCpltCallback) {
+			hdma->XferCpltCallback(hdma);
+		}
+	}
+}
+
+/* UART ----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart) {
+	hostUart_t *uart;
+
+	if (huart == NULL || (uart = hostUartOf(huart->Instance)) == NULL) {
+		return HAL_ERROR;
+	}
+	if (huart->gState == HAL_UART_STATE_RESET) {
+		HAL_UART_MspInit(huart);
+	}
+	uart->handle = huart;
+	huart->Instance->SR = USART_SR_TC | USART_SR_TXE;
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_DeInit(UART_HandleTypeDef *huart) {
+	HAL_UART_MspDeInit(huart);
+	huart->gState = HAL_UART_STATE_RESET;
+	huart->RxState = HAL_UART_STATE_RESET;
+	return HAL_OK;
+}
+
+__weak void HAL_UART_MspInit(UART_HandleTypeDef *huart) {
+	(void)huart;
+}
+
+__weak void HAL_UART_MspDeInit(UART_HandleTypeDef *huart) {
+	(void)huart;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout) {
+	hostUart_t *uart = hostUartOf(huart->Instance);
+
+	(void)Timeout;
+	if (uart == NULL || uart->fd < 0) {
+		return HAL_ERROR;
+	}
+	if (huart->gState != HAL_UART_STATE_READY) {
+		return HAL_BUSY;
+	}
+	hostWrite(uart->fd, pData, Size);
+	uart->txBytes += Size;
+	return HAL_OK;
+}
+
+/* The bytes are written at once, TC follows after their time on the wire */
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size) {
+	hostUart_t *uart = hostUartOf(huart->Instance);
+
+	if (uart == NULL || pData == NULL || Size == 0) {
+		return HAL_ERROR;
+	}
+	if (huart->gState != HAL_UART_STATE_READY) {
+		return HAL_BUSY;
+	}
+	huart->gState = HAL_UART_STATE_BUSY_TX;
+	huart->pTxBuffPtr = pData;
+	huart->TxXferSize = Size;
+	huart->TxXferCount = 0;
+	if (uart->fd >= 0) {
+		hostWrite(uart->fd, pData, Size);
+	}
+	uart->txBytes += Size;
+	huart->Instance->SR &= ~USART_SR_TC;
+	huart->Instance->CR1 |= USART_CR1_TCIE;
+	uart->txDoneTick = hostTicks + hostWireMs(uart, Size);
+	uart->txBusy = 1;
+	return HAL_OK;
+}
+
+void HAL_UART_IRQHandler(UART_HandleTypeDef *huart) {
+	if ((huart->Instance->SR & USART_SR_TC) && (huart->Instance->CR1 & USART_CR1_TCIE)) {
+		huart->Instance->CR1 &= ~USART_CR1_TCIE;
+		huart->gState = HAL_UART_STATE_READY;
+		HAL_UART_TxCpltCallback(huart);
+	}
+}
+
+__weak void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+	(void)huart;
+}
+
+/* TIM -----------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim) {
+	if (htim == NULL) {
+		return HAL_ERROR;
+	}
+	HAL_TIM_Base_MspInit(htim);
+	htim->Instance->CR2 = (htim->Init.Prescaler + 1) * (htim->Init.Period + 1) / 72;		//update period in us at 72 MHz
+	return HAL_OK;
+}
+
+__weak void HAL_TIM_Base_MspInit(TIM_HandleTypeDef *htim) {
+	(void)htim;
+}
+
+__weak void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef *htim) {
+	(void)htim;
+}
+
+HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *htim, TIM_ClockConfigTypeDef *sClockSourceConfig) {
+	(void)htim;
+	(void)sClockSourceConfig;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *htim, TIM_MasterConfigTypeDef *sMasterConfig) {
+	(void)htim;
+	(void)sMasterConfig;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim) {
+	htim->Instance->DIER |= TIM_DIER_UIE;
+	htim->Instance->CR1 |= TIM_CR1_CEN;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim) {
+	htim->Instance->DIER &= ~TIM_DIER_UIE;
+	htim->Instance->CR1 &= ~TIM_CR1_CEN;
+	return HAL_OK;
+}
+
+void HAL_TIM_IRQHandler(TIM_HandleTypeDef *htim) {
+	if ((htim->Instance->SR & 1) && (htim->Instance->DIER & TIM_DIER_UIE)) {
+		htim->Instance->SR &= ~1u;
+		HAL_TIM_PeriodElapsedCallback(htim);
+	}
+}
+
+__weak void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim) {
+	(void)htim;
+}
+
+/* FLASH ---------------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+	hostFlashLocked = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+	hostFlashLocked = 1;
+	return HAL_OK;
+}
+
+/* Like the F1 controller: only an erased halfword may be programmed, except with zero */
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+	uint8_t count = (TypeProgram == FLASH_TYPEPROGRAM_DOUBLEWORD) ? 4 : (TypeProgram == FLASH_TYPEPROGRAM_WORD) ? 2 : 1;
+	uint16_t *cell;
+	uint8_t i;
+
+	if (hostFlashLocked || Address < FLASH_BASE || Address + count * 2 > FLASH_BASE + HOST_FLASH_SIZE || (Address & 1)) {
+		return HAL_ERROR;
+	}
+	for (i = 0; i < count; i++) {
+		cell = (uint16_t *)(uintptr_t)(Address + i * 2);
+		if (*cell != 0xFFFF && (uint16_t)Data != 0) {
+			fprintf(stderr, "host: programming non-erased flash at 0x%08X\n", (unsigned)(Address + i * 2));
+			return HAL_ERROR;
+		}
+		*cell = (uint16_t)Data;
+		Data >>= 16;
+		hostFlashWrites++;
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError) {
+	uint32_t page;
+
+	*PageError = 0xFFFFFFFF;
+	if (hostFlashLocked) {
+		return HAL_ERROR;
+	}
+	if (pEraseInit->TypeErase == FLASH_TYPEERASE_MASSERASE) {
+		memset(hostFlash, 0xFF, HOST_FLASH_SIZE);
+		hostFlashErases += HOST_FLASH_SIZE / FLASH_PAGE_SIZE;
+		return HAL_OK;
+	}
+	for (page = 0; page < pEraseInit->NbPages; page++) {
+		uint32_t addr = pEraseInit->PageAddress + page * FLASH_PAGE_SIZE;
+
+		if (addr < FLASH_BASE || addr + FLASH_PAGE_SIZE > FLASH_BASE + HOST_FLASH_SIZE) {
+			*PageError = addr;
+			return HAL_ERROR;
+		}
+		memset(hostFlash + (addr - FLASH_BASE), 0xFF, FLASH_PAGE_SIZE);
+		hostFlashErases++;
+	}
+	return HAL_OK;
+}
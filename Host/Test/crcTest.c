@@ -0,0 +1,116 @@
+/*
+ * Known-answer test and benchmark of the table-driven Modbus CRC (Src/modbusCrc.c)
+ * against the bit-serial GetCRC16 it replaced, kept below as the reference.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "modbusCrc.h"
+
+#define CRC_TEST_FRAMES		100000
+#define CRC_BENCH_ROUNDS	200000
+
+/* GetCRC16 as Src/modbusToPC.c had it */
+static uint16_t GetCRC16(uint8_t *arr_buff, uint8_t len) {
+	uint16_t crc = 0xFFFF;
+	uint8_t i, j;
+	for (j = 0; j < len; j++) {
+		crc = crc ^*arr_buff++;
+		for (i = 0; i < 8; i++) {
+			if ((crc & 0x0001) > 0) {
+				crc = crc >> 1;
+				crc = crc ^ 0xa001;
+			}
+			else
+				crc = crc >> 1;
+		}
+	}
+	return (crc);
+}
+
+static const struct {
+	uint8_t frame[8];
+	uint8_t len;
+	uint16_t crc;
+} crcKnown[] = {
+	{ { 0x01, 0x03, 0x00, 0x00, 0x00, 0x01 }, 6, 0x0A84 },		//read one holding register, sent as 84 0A
+	{ { 0x01, 0x03, 0x00, 0x00, 0x00, 0x08 }, 6, 0x0C44 },
+	{ { 0x01, 0x06, 0x00, 0x05, 0x00, 0x1E }, 6, 0xC319 },
+	{ { 0x11, 0x03, 0x00, 0x6B, 0x00, 0x03 }, 6, 0x8776 },		//Modbus over serial line specification example
+	{ { 0 }, 0, 0xFFFF },
+};
+
+static double crcNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+	uint8_t buf[258];
+	volatile uint16_t sink = 0;
+	uint16_t crc;
+	uint32_t fail = 0;
+	uint32_t i;
+	uint32_t n;
+	uint32_t j;
+	double t0;
+	double tOld;
+	double tNew;
+
+	for (i = 0; i < sizeof(crcKnown) / sizeof(crcKnown[0]); i++) {
+		if (modbusCrc16(crcKnown[i].frame, crcKnown[i].len) != crcKnown[i].crc ||
+			GetCRC16((uint8_t *)crcKnown[i].frame, crcKnown[i].len) != crcKnown[i].crc) {
+			printf("crc: known answer %u wrong\n", i);
+			fail++;
+		}
+	}
+
+	srand(1);
+	for (i = 0; i < CRC_TEST_FRAMES; i++) {
+		n = rand() % 256;
+		for (j = 0; j < n; j++) {
+			buf[j] = rand();
+		}
+		crc = MODBUS_CRC_INIT;
+		for (j = 0; j < n; j++) {
+			crc = modbusCrcUpdate(crc, buf[j]);
+		}
+		if (crc != GetCRC16(buf, n) || modbusCrc16(buf, n) != crc ||
+			modbusCrcBlock(modbusCrcBlock(MODBUS_CRC_INIT, buf, n / 2), buf + n / 2, n - n / 2) != crc) {
+			printf("crc: %u byte frame differs from GetCRC16\n", n);
+			fail++;
+			break;
+		}
+		buf[n] = crc & 0xFF;
+		buf[n + 1] = crc >> 8;
+		if (modbusCrc16(buf, n + 2) != MODBUS_CRC_RESIDUE) {
+			printf("crc: residue of a signed %u byte frame is not zero\n", n);
+			fail++;
+			break;
+		}
+	}
+	printf("crc: %u known answers, %u random frames against GetCRC16, %u failures\n",
+		(uint32_t)(sizeof(crcKnown) / sizeof(crcKnown[0])), CRC_TEST_FRAMES, fail);
+
+	for (j = 0; j < 8; j++) {
+		buf[j] = rand();								//an 8-byte request, the common case
+	}
+	t0 = crcNow();
+	for (i = 0; i < CRC_BENCH_ROUNDS; i++) {
+		buf[0] = i;
+		sink += GetCRC16(buf, 8);
+	}
+	tOld = crcNow() - t0;
+	t0 = crcNow();
+	for (i = 0; i < CRC_BENCH_ROUNDS; i++) {
+		buf[0] = i;
+		sink += modbusCrc16(buf, 8);
+	}
+	tNew = crcNow() - t0;
+	printf("crc: 8-byte frame, GetCRC16 %.1f ns, modbusCrc16 %.1f ns (%.1fx)\n",
+		tOld * 1e9 / CRC_BENCH_ROUNDS, tNew * 1e9 / CRC_BENCH_ROUNDS, tOld / tNew);
+
+	return fail ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * Flash simulator for the settings log (Src/settings.c): the HAL flash calls over a
+ * 64 KB image mapped at FLASH_BASE, counting page erases and halfword programs,
+ * with a virtual HAL_GetTick and a power-cut budget.
+ *
+ * Counts the erases of setpoint changes through the log against the old path, one
+ * STMFLASH_Write(FLASH_SAVE_ADDR, tempAndHumi, 2) per change, checks that the quiet
+ * period and SETTINGS_MAX_DEFER_MS hold, and cuts the power at every point of random
+ * commits and compactions: after a reboot every key must read its old or its new value.
+ */
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "stmFlash.h"
+#include "settings.h"
+
+#define FLASH_SIM_SIZE			(64 * 1024)
+#define FLASH_SIM_CHANGES		20000				//setpoint changes of the wear comparison
+#define FLASH_SIM_BURSTS		200					//operator sessions of the burst scenario
+#define FLASH_SIM_TRIALS		20000				//power-cut trials
+#define FLASH_SIM_TICK_MS		100					//settingsHandle period, as scheduled in main.c
+#define FLASH_SIM_ERASE_MS		20					//CPU stall of one page erase
+
+static uint8_t *flashSimImage;
+static uint8_t flashSimLocked = 1;
+static uint32_t flashSimErases = 0;
+static uint32_t flashSimPrograms = 0;
+static uint32_t flashSimFaults = 0;					//programs of a non-erased halfword, erases while locked
+static int32_t flashSimBudget = -1;					//operations until the power fails, -1: never
+static jmp_buf flashSimCut;
+static uint32_t flashSimTick = 0;
+static uint32_t flashSimSeed = 1;
+
+static uint32_t flashSimRandom(void) {
+	flashSimSeed = flashSimSeed * 1103515245 + 12345;
+	return flashSimSeed >> 16;
+}
+
+/* Spends one operation of the budget; the last one is torn and the power fails */
+static uint8_t flashSimPowerFails(void) {
+	if (flashSimBudget < 0 || flashSimBudget-- > 0) {
+		return 0;
+	}
+	flashSimBudget = -1;
+	return 1;
+}
+
+uint32_t HAL_GetTick(void) {
+	return flashSimTick;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void) {
+	flashSimLocked = 0;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void) {
+	flashSimLocked = 1;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data) {
+	uint16_t *cell = (uint16_t *)(uintptr_t)Address;
+
+	if (flashSimLocked || TypeProgram != FLASH_TYPEPROGRAM_HALFWORD || Address < FLASH_BASE ||
+		Address + 2 > FLASH_BASE + FLASH_SIM_SIZE || (Address & 1)) {
+		flashSimFaults++;
+		return HAL_ERROR;
+	}
+	if (*cell != 0xFFFF && (uint16_t)Data != 0) {
+		flashSimFaults++;
+	}
+	if (flashSimPowerFails()) {
+		*cell &= (uint16_t)Data | (uint16_t)flashSimRandom();	//only some of the bits got programmed
+		longjmp(flashSimCut, 1);
+	}
+	*cell &= (uint16_t)Data;						//programming only clears bits
+	flashSimPrograms++;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError) {
+	uint32_t offset = pEraseInit->PageAddress - FLASH_BASE;
+	uint32_t page;
+
+	*PageError = 0xFFFFFFFF;
+	if (flashSimLocked || pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES || offset % FLASH_PAGE_SIZE ||
+		offset + pEraseInit->NbPages * FLASH_PAGE_SIZE > FLASH_SIM_SIZE) {
+		flashSimFaults++;
+		return HAL_ERROR;
+	}
+	for (page = 0; page < pEraseInit->NbPages; page++, offset += FLASH_PAGE_SIZE) {
+		if (flashSimPowerFails()) {
+			memset(flashSimImage + offset, 0xFF, flashSimRandom() % FLASH_PAGE_SIZE);	//erase torn part way
+			longjmp(flashSimCut, 1);
+		}
+		memset(flashSimImage + offset, 0xFF, FLASH_PAGE_SIZE);
+		flashSimErases++;
+	}
+	return HAL_OK;
+}
+
+/* Blank flash, a fresh store, counters zeroed */
+static void flashSimFormat(void) {
+	memset(flashSimImage, 0xFF, FLASH_SIM_SIZE);
+	flashSimTick = 0;
+	settingsInit();
+	flashSimErases = 0;
+	flashSimPrograms = 0;
+	settingsCommitCount = 0;
+}
+
+/* The operator changes the setpoints FLASH_SIM_CHANGES times, each change written on its own */
+static uint32_t flashSimWear(void) {
+	uint16_t tempAndHumi[2] = { 250, 550 };
+	uint32_t oldErases;
+	uint32_t oldPrograms;
+	uint32_t i;
+
+	flashSimFormat();
+	for (i = 0; i < FLASH_SIM_CHANGES; i++) {
+		tempAndHumi[i & 1] += (i & 2) ? 1 : -1;
+		STMFLASH_Write(SETTINGS_BASE_ADDR, tempAndHumi, 2);
+	}
+	oldErases = flashSimErases;
+	oldPrograms = flashSimPrograms;
+
+	flashSimFormat();
+	for (i = 0; i < FLASH_SIM_CHANGES; i++) {
+		tempAndHumi[i & 1] += (i & 2) ? 1 : -1;
+		settingsSet(SETTINGS_KEY_WENDU_SET + (i & 1), tempAndHumi[i & 1]);
+		settingsCommit();
+	}
+	printf("flash: %u setpoint changes, each written: old path %u erases (%.1f s stalled) %u halfwords, settings log %u erases %u halfwords\n",
+		FLASH_SIM_CHANGES, oldErases, oldErases * FLASH_SIM_ERASE_MS / 1000.0, oldPrograms, flashSimErases, flashSimPrograms);
+
+	settingsInit();
+	if (settingsGet(SETTINGS_KEY_WENDU_SET, 0) != tempAndHumi[0] || settingsGet(SETTINGS_KEY_SHIDU_SET, 0) != tempAndHumi[1]) {
+		printf("flash: setpoints lost after %u changes\n", FLASH_SIM_CHANGES);
+		return 1;
+	}
+	return flashSimErases * 100 > oldErases ? 1 : 0;
+}
+
+/* Operator sessions of a few nudges each, written by settingsHandle; every change must land within the defer limit */
+static uint32_t flashSimBursts(void) {
+	uint32_t changes = 0;
+	uint32_t commits;
+	uint32_t oldest = 0;						//tick of the oldest change not yet written, 0: none
+	uint32_t worst = 0;
+	uint32_t until;
+	uint32_t next;
+	uint32_t burst;
+	uint32_t n;
+	uint16_t value = 250;
+	uint16_t written = 0xFFFF;
+
+	flashSimFormat();
+	flashSimTick = 1;
+	for (burst = 0; burst < FLASH_SIM_BURSTS + 1; burst++) {
+		n = burst < FLASH_SIM_BURSTS ? 1 + flashSimRandom() % 10 : 600;	//the last session never settles
+		next = flashSimTick;
+		until = flashSimTick + 60000 + flashSimRandom() % 600000;
+		while (flashSimTick < until || n > 0 || oldest) {
+			if (n > 0 && flashSimTick >= next) {
+				value += (flashSimRandom() & 1) ? 1 : -1;
+				settingsSet(SETTINGS_KEY_WENDU_SET, value);
+				oldest = value == written ? 0 : oldest ? oldest : flashSimTick;	//nudged back, nothing left to write
+				changes++;
+				n--;
+				next = flashSimTick + (burst < FLASH_SIM_BURSTS ? 300 + flashSimRandom() % 1200 : 1000);
+			}
+			commits = settingsCommitCount;
+			settingsHandle();
+			if (settingsCommitCount != commits) {
+				worst = flashSimTick - oldest > worst ? flashSimTick - oldest : worst;
+				oldest = 0;
+				written = value;
+			}
+			flashSimTick += FLASH_SIM_TICK_MS;
+		}
+	}
+	printf("flash: %u operator sessions, %u changes: old path %u erases, settings log %u commits %u erases, longest defer %u ms\n",
+		FLASH_SIM_BURSTS + 1, changes, changes, settingsCommitCount, flashSimErases, worst);
+
+	settingsInit();
+	if (settingsGet(SETTINGS_KEY_WENDU_SET, 0) != value) {
+		printf("flash: setpoint lost after the sessions\n");
+		return 1;
+	}
+	return worst > SETTINGS_MAX_DEFER_MS + FLASH_SIM_TICK_MS ? 1 : 0;
+}
+
+/* Random commits with the power cut after a random number of flash operations, then a reboot */
+static uint32_t flashSimPowerCuts(void) {
+	uint16_t stored[SETTINGS_KEY_COUNT];
+	uint16_t wanted[SETTINGS_KEY_COUNT];
+	uint32_t cuts = 0;
+	uint32_t compactions = 0;
+	uint32_t errors = 0;
+	uint32_t trial;
+	uint32_t erases;
+	uint16_t value;
+	uint16_t key;
+	uint32_t n;
+
+	flashSimFormat();
+	for (key = 0; key < SETTINGS_KEY_COUNT; key++) {
+		stored[key] = 0xFFFF;					//no record yet, settingsGet falls back to the default
+	}
+	for (trial = 0; trial < FLASH_SIM_TRIALS; trial++) {
+		memcpy(wanted, stored, sizeof(wanted));
+		for (n = 1 + flashSimRandom() % 4; n > 0; n--) {
+			key = flashSimRandom() % SETTINGS_KEY_COUNT;
+			wanted[key] = flashSimRandom() % 0xFFFF;
+			settingsSet(key, wanted[key]);
+		}
+
+		erases = flashSimErases;
+		flashSimBudget = flashSimRandom() % 64;
+		if (setjmp(flashSimCut) == 0) {
+			settingsCommit();
+			flashSimBudget = -1;
+		}
+		else {
+			cuts++;
+		}
+		flashSimLocked = 1;						//reboot
+		settingsInit();
+
+		for (key = 0; key < SETTINGS_KEY_COUNT; key++) {
+			value = settingsGet(key, 0xFFFF);
+			if (value != stored[key] && value != wanted[key]) {
+				if (errors++ < 5) {
+					printf("flash: trial %u, key %u reads 0x%04X, neither 0x%04X nor 0x%04X\n",
+						trial, key, value, stored[key], wanted[key]);
+				}
+			}
+			stored[key] = value;
+		}
+		compactions += flashSimErases != erases;
+	}
+	printf("flash: %u power-cut trials, %u cut, %u with a page erase, %u keys wrong, %u flash faults\n",
+		FLASH_SIM_TRIALS, cuts, compactions, errors, flashSimFaults);
+	return errors || flashSimFaults;
+}
+
+int main(void) {
+	uint32_t fail = 0;
+
+	flashSimImage = mmap((void *)(uintptr_t)FLASH_BASE, FLASH_SIM_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if (flashSimImage != (uint8_t *)(uintptr_t)FLASH_BASE) {
+		perror("flash: mapping at FLASH_BASE");
+		return 2;
+	}
+
+	fail += flashSimWear();
+	fail += flashSimBursts();
+	fail += flashSimPowerCuts();
+	return fail ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * Throughput of the Gizwits frame parser over captured GAgent link traffic
+ * (Test/Traces, see recordTraces.py), against the byte-at-a-time parser it
+ * replaced, kept below as the reference.
+ *
+ * gizwits_protocol.c is compiled into this file so its static parser can be
+ * called directly; the modules it calls besides the ring buffer are stubbed.
+ * Both parsers must return the same frames, and every traced frame must pass.
+ * A circular DMA lapping the reader in the middle of a frame must cost that frame
+ * only, not a checksum error from joining it to the bytes after the gap.
+ */
+#define LOG_LEVEL_MAX	LOG_LEVEL_OFF
+#define PROFILE_ENABLED	0
+#include "../../Gizwits/gizwits_protocol.c"
+#include <time.h>
+
+#define FRAMER_BENCH_BYTES	(8 * 1024 * 1024)	//traffic parsed per parser
+#define FRAMER_CHUNK_MAX	64					//largest write into the ring, a DMA half transfer
+
+/* Modules gizwits_protocol.c calls, not used by the parser */
+uint32_t backlogMerged, backlogSpilled, backlogDropped;
+void backlogInit(void) {}
+uint16_t backlogCount(void) { return 0; }
+void backlogPush(uint32_t time, const devStatus_t *status, uint8_t merge) { (void)time; (void)status; (void)merge; }
+int8_t backlogPeek(backlogEntry_t *entry) { (void)entry; return -1; }
+int8_t backlogPop(backlogEntry_t *entry) { (void)entry; return -1; }
+void backlogRequeue(uint32_t time, const devStatus_t *status) { (void)time; (void)status; }
+int8_t gizwitsEventProcess(eventInfo_t *info, uint8_t *data, uint32_t len) { (void)info; (void)data; (void)len; return 0; }
+void mcuModuleReset(uint8_t active) { (void)active; }
+void mcuRestart(void) {}
+uint16_t settingsGet(uint16_t key, uint16_t defaultValue) { (void)key; return defaultValue; }
+int32_t uartWrite(uint8_t *buf, uint32_t len) { (void)buf; return len; }
+int32_t uartWriteAsync(uint8_t *buf, uint32_t len, uartTxHandle_t *handle) { (void)buf; if (handle) *handle = 0; return len; }
+uint8_t uartTxComplete(uartTxHandle_t handle) { (void)handle; return 1; }
+uint32_t gizGetTimerCount(void) { return 0; }
+
+/* gizProtocolGetOnePacket before the resumable framer */
+static int8_t oldGetOnePacket(rb_t *rb, uint8_t *gizdata, uint16_t *len)
+{
+	int32_t ret = 0;
+	uint8_t sum = 0;
+	int32_t i = 0;
+	uint8_t tmpData;
+	uint8_t tmpLen = 0;
+	uint16_t tmpCount = 0;
+	static uint8_t protocolFlag = 0;
+	static uint16_t protocolCount = 0;
+	static uint8_t lastData = 0;
+	static uint8_t debugCount = 0;
+	uint8_t *protocolBuff = gizdata;
+	protocolHead_t *head = NULL;
+
+	if ((NULL == rb) || (NULL == gizdata) || (NULL == len))
+	{
+		return -1;
+	}
+
+	tmpLen = rbCanRead(rb);
+	if (0 == tmpLen)
+	{
+		return -1;
+	}
+
+	for (i = 0; i<tmpLen; i++)
+	{
+		ret = rbRead(rb, &tmpData, 1);
+		if (0 != ret)
+		{
+			if ((0xFF == lastData) && (0xFF == tmpData))
+			{
+				if (0 == protocolFlag)
+				{
+					protocolBuff[0] = 0xFF;
+					protocolBuff[1] = 0xFF;
+					protocolCount = 2;
+					protocolFlag = 1;
+				}
+				else
+				{
+					if ((protocolCount > 4) && (protocolCount != tmpCount))
+					{
+						protocolBuff[0] = 0xFF;
+						protocolBuff[1] = 0xFF;
+						protocolCount = 2;
+					}
+				}
+			}
+			else if ((0xFF == lastData) && (0x55 == tmpData))
+			{
+			}
+			else
+			{
+				if (1 == protocolFlag)
+				{
+					protocolBuff[protocolCount] = tmpData;
+					protocolCount++;
+
+					if (protocolCount > 4)
+					{
+						head = (protocolHead_t *)protocolBuff;
+						tmpCount = exchangeBytes(head->len) + 4;
+						if (protocolCount == tmpCount)
+						{
+							break;
+						}
+					}
+				}
+			}
+
+			lastData = tmpData;
+			debugCount++;
+		}
+	}
+
+	if ((protocolCount > 4) && (protocolCount == tmpCount))
+	{
+		sum = gizProtocolSum(protocolBuff, protocolCount);
+
+		if (protocolBuff[protocolCount - 1] == sum)
+		{
+			memcpy(gizdata, protocolBuff, tmpCount);
+			*len = tmpCount;
+			protocolFlag = 0;
+
+			protocolCount = 0;
+			debugCount = 0;
+			lastData = 0;
+
+			return 0;
+		}
+		else
+		{
+			return -2;
+		}
+	}
+
+	return 1;
+}
+
+typedef int8_t (*framerParse_t)(rb_t *rb, uint8_t *gizdata, uint16_t *len);
+
+typedef struct {
+	uint32_t frames;
+	uint32_t failed;
+	uint32_t digest;						//FNV-1a over every frame returned
+	double seconds;
+} framerRun_t;
+
+static uint8_t *framerTrace;
+static uint32_t framerTraceLen;
+
+static double framerNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void framerLoad(const char *path) {
+	FILE *f = fopen(path, "rb");
+	long size;
+
+	if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0) {
+		fprintf(stderr, "framer: cannot read %s\n", path);
+		exit(2);
+	}
+	rewind(f);
+	framerTrace = realloc(framerTrace, framerTraceLen + size);
+	if (fread(framerTrace + framerTraceLen, 1, size, f) != (size_t)size) {
+		fprintf(stderr, "framer: short read on %s\n", path);
+		exit(2);
+	}
+	framerTraceLen += size;
+	fclose(f);
+}
+
+/* Feeds the traces through pRb in DMA-sized chunks of varying length and parses after each one */
+static framerRun_t framerRun(framerParse_t parse, uint32_t bytes) {
+	framerRun_t run = { 0, 0, 2166136261u, 0 };
+	uint8_t frame[MAX_PACKAGE_LEN];
+	uint16_t len = 0;
+	uint32_t done = 0;
+	uint32_t pos = 0;
+	uint32_t chunk;
+	uint32_t seed = 1;
+	int8_t ret;
+	uint16_t i;
+	double t0;
+
+	pRb.rbCapacity = RB_MAX_LEN;
+	pRb.rbBuff = rbBuf;
+	rbCreate(&pRb);
+	memset(&gizwitsProtocol.framer, 0, sizeof(gizwitsProtocol.framer));
+
+	t0 = framerNow();
+	while (done < bytes) {
+		seed = seed * 1103515245 + 12345;
+		chunk = 1 + (seed >> 16) % FRAMER_CHUNK_MAX;
+		if (chunk > framerTraceLen - pos) {
+			chunk = framerTraceLen - pos;
+		}
+		rbWrite(&pRb, framerTrace + pos, chunk);
+		pos = (pos + chunk) % framerTraceLen;
+		done += chunk;
+
+		while ((ret = parse(&pRb, frame, &len)) != -1 && ret != 1) {
+			if (ret == 0) {
+				run.frames++;
+				for (i = 0; i < len; i++) {
+					run.digest = (run.digest ^ frame[i]) * 16777619u;
+				}
+			} else {
+				run.failed++;
+			}
+		}
+	}
+	run.seconds = framerNow() - t0;
+	return run;
+}
+
+/* Stops the reader inside the first frame while the DMA writes on for more than a lap */
+static uint32_t framerOverrun(void) {
+	uint8_t frame[MAX_PACKAGE_LEN];
+	uint8_t *span;
+	uint16_t len = 0;
+	uint32_t frames = 0;
+	uint32_t failed = 0;
+	uint32_t pos;
+	uint32_t end;
+	int32_t n;
+	int8_t ret;
+
+	pRb.rbCapacity = RB_MAX_LEN;
+	pRb.rbBuff = rbBuf;
+	rbCreate(&pRb);
+	memset(&gizwitsProtocol.framer, 0, sizeof(gizwitsProtocol.framer));
+
+	//the reader resumes just after a header, where the bytes would complete the cut frame
+	for (end = 6 + RB_MAX_LEN; framerTrace[end % framerTraceLen] != 0xFF || framerTrace[(end + 1) % framerTraceLen] != 0xFF; end++) {
+	}
+	end += 2;
+
+	rbWrite(&pRb, framerTrace, 6);
+	gizProtocolGetOnePacket(&pRb, frame, &len);
+	for (pos = 6; pos < end; pos++) {						//published past the free space, as the DMA does
+		pRb.rbBuff[pRb.rbTail & (RB_MAX_LEN - 1)] = framerTrace[pos % framerTraceLen];
+		rbPublish(&pRb, 1);
+	}
+	for (; pos < 6 + 2 * framerTraceLen; pos += n) {
+		n = rbReserve(&pRb, &span);
+		n = min(n, 16);
+		memcpy(span, framerTrace + pos % framerTraceLen, n);
+		n = rbPublish(&pRb, n);
+		while ((ret = gizProtocolGetOnePacket(&pRb, frame, &len)) != -1 && ret != 1) {
+			frames += ret == 0;
+			failed += ret != 0;
+		}
+	}
+	printf("framer: overrun of %u bytes mid-frame, %u frames after it, %u bad, %u frame cut\n",
+		pRb.rbDropped, frames, failed, gizwitsProtocol.framer.overruns);
+	return failed || frames == 0 || gizwitsProtocol.framer.overruns != 1 ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	framerRun_t old;
+	framerRun_t cur;
+	int i;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s trace.bin...\n", argv[0]);
+		return 2;
+	}
+	for (i = 1; i < argc; i++) {
+		framerLoad(argv[i]);
+	}
+
+	old = framerRun(oldGetOnePacket, FRAMER_BENCH_BYTES);
+	cur = framerRun(gizProtocolGetOnePacket, FRAMER_BENCH_BYTES);
+	printf("framer: %u trace bytes, %u frames parsed from %u MB\n", framerTraceLen, cur.frames, FRAMER_BENCH_BYTES >> 20);
+	printf("framer: old parser %.1f MB/s, gizProtocolGetOnePacket %.1f MB/s (%.1fx)\n",
+		FRAMER_BENCH_BYTES / old.seconds / 1e6, FRAMER_BENCH_BYTES / cur.seconds / 1e6, old.seconds / cur.seconds);
+
+	if (cur.failed || old.failed || cur.frames != old.frames || cur.digest != old.digest || cur.frames == 0) {
+		printf("framer: FAILED, old %u frames %u bad, new %u frames %u bad, %s frames\n",
+			old.frames, old.failed, cur.frames, cur.failed, cur.digest == old.digest ? "same" : "different");
+		return 1;
+	}
+	return framerOverrun();
+}
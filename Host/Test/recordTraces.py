@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""Record the GAgent link traces in Host/Test/Traces from the host build.
+
+    recordTraces.py [seconds]          (from Host/, after "make -C Host")
+
+Starts Build/GPRS-host on a fresh flash image, plays a fake GAgent and a Modbus
+master against it and writes both directions of USART2 as raw bytes:
+
+    module-to-mcu.bin            what the GAgent sent: device info request, wifi
+                                 status, heartbeats, cloud control and status reads,
+                                 ACKs of every report
+    mcu-to-module.bin            what the MCU sent, standard P0 status reports
+    mcu-to-module-compact.bin    the same load with SETTINGS_KEY_COMPACT_REPORT set
+
+The load is a seeded random walk of the sensor registers with occasional alarm
+flips and setpoint steps, so a new recording differs only where the firmware
+does. The traces feed "make -C Host test" (framerBench, Tools/compactreport.py).
+"""
+
+import os
+import random
+import select
+import subprocess
+import sys
+import tempfile
+import time
+import tty
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+HOST = os.path.join(HERE, "..")
+TRACES = os.path.join(HERE, "Traces")
+
+CMD_GET_DEVICE_INTO = 0x01
+CMD_ISSUED_P0 = 0x03
+CMD_REPORT_P0 = 0x05
+CMD_HEARTBEAT = 0x07
+CMD_WIFISTATUS = 0x0D
+ACTION_CONTROL_DEVICE = 0x01
+ACTION_READ_DEV_STATUS = 0x02
+
+SETTINGS_KEY_DEADBAND = 0x0202      # five absolute deadbands, one LSB each so every step reports
+SETTINGS_KEY_COMPACT_REPORT = 0x020D
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return bytes([crc & 0xFF, crc >> 8])
+
+
+class Modbus:
+    def __init__(self, path):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+
+    def xfer(self, request):
+        os.write(self.fd, request + crc16(request))
+        reply = b""
+        end = time.time() + 1
+        while time.time() < end:
+            if select.select([self.fd], [], [], 0.05)[0]:
+                reply += os.read(self.fd, 256)
+            elif reply:
+                break
+        return reply
+
+    def write_setting(self, addr, value):
+        self.xfer(bytes([1, 6, addr >> 8, addr & 0xFF, value >> 8, value & 0xFF]))
+
+    def write_registers(self, first, values):
+        body = b"".join(bytes([v >> 8, v & 0xFF]) for v in values)
+        self.xfer(bytes([1, 0x10, 0, first, 0, len(values), len(body)]) + body)
+
+
+class GAgent:
+    def __init__(self, path, rx, tx):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        self.rx = rx
+        self.tx = tx
+        self.sn = 0xF8                  # wraps through 0xFF, so the trace has stuffed bytes
+        self.pending = b""
+
+    def send(self, cmd, payload=b"", sn=None):
+        if sn is None:
+            sn = self.sn
+            self.sn = (self.sn + 1) & 0xFF
+        body = bytes([0, 5 + len(payload), cmd, sn, 0, 0]) + payload
+        body += bytes([sum(body) & 0xFF])
+        frame = b"\xff\xff" + body[:2] + body[2:].replace(b"\xff", b"\xff\x55")
+        os.write(self.fd, frame)
+        self.rx.write(frame)
+
+    def pump(self, seconds):
+        end = time.time() + seconds
+        while time.time() < end:
+            if not select.select([self.fd], [], [], 0.01)[0]:
+                continue
+            data = os.read(self.fd, 512)
+            self.tx.write(data)
+            self.pending += data
+            self.acknowledge()
+
+    def acknowledge(self):
+        while True:
+            i = self.pending.find(b"\xff\xff")
+            if i < 0 or len(self.pending) < i + 4:
+                return
+            need = (self.pending[i + 2] << 8) | self.pending[i + 3]
+            body = bytearray()
+            j = i + 4
+            while j < len(self.pending) and len(body) < need:
+                body.append(self.pending[j])
+                j += 2 if self.pending[j] == 0xFF and self.pending[j + 1:j + 2] == b"\x55" else 1
+            if len(body) < need:
+                return
+            self.pending = self.pending[j:]
+            if body[0] == CMD_REPORT_P0:
+                self.send(CMD_REPORT_P0 + 1, sn=body[1])
+
+
+def record(binary, seconds, compact, rx, tx, seed):
+    rnd = random.Random(seed)
+    work = tempfile.mkdtemp(prefix="gprs-trace-")
+    env = dict(os.environ, HOST_FAST_UART="1", HOST_FLASH=os.path.join(work, "flash.bin"),
+               HOST_USART1_PTY=os.path.join(work, "modbus"), HOST_USART2_PTY=os.path.join(work, "gagent"))
+    host = subprocess.Popen([binary], env=env, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        while not os.path.exists(env["HOST_USART2_PTY"]):
+            time.sleep(0.05)
+        modbus = Modbus(env["HOST_USART1_PTY"])
+        gagent = GAgent(env["HOST_USART2_PTY"], rx, tx)
+
+        for key in range(5):
+            modbus.write_setting(SETTINGS_KEY_DEADBAND + key, 1)
+        modbus.write_setting(SETTINGS_KEY_COMPACT_REPORT, compact)
+        gagent.send(CMD_GET_DEVICE_INTO)
+        gagent.send(CMD_WIFISTATUS, bytes([0x00, 0x30]))
+        gagent.pump(1)
+
+        regs = {5: 24, 6: 50, 7: 230, 8: 550, 9: 1, 10: 0, 11: 0, 12: 0, 13: 40, 14: 60, 15: 10}
+        start = time.time()
+        while time.time() - start < seconds:
+            for r in (7, 8):
+                regs[r] = max(0, regs[r] + rnd.choice((-2, -1, 0, 1, 2)))
+            for r in (13, 14, 15):
+                regs[r] = min(100, max(0, regs[r] + rnd.choice((-5, 0, 0, 0, 5))))
+            if rnd.random() < 0.05:
+                regs[rnd.choice((9, 10, 11, 12))] ^= 1
+            if rnd.random() < 0.01:
+                regs[5] += rnd.choice((-1, 1))
+            modbus.write_registers(5, [regs[r] for r in range(5, 16)])
+
+            event = rnd.random()
+            if event < 0.03:
+                gagent.send(CMD_HEARTBEAT)
+            elif event < 0.05:
+                gagent.send(CMD_ISSUED_P0, bytes([ACTION_READ_DEV_STATUS]))
+            elif event < 0.07:
+                value = rnd.randrange(200, 300)
+                gagent.send(CMD_ISSUED_P0, bytes([ACTION_CONTROL_DEVICE, 0x09, rnd.randrange(8),
+                                                  value >> 8, value & 0xFF, 0, 50, 0, 0]))
+            gagent.pump(0.3)
+        gagent.pump(3)
+    finally:
+        host.terminate()
+        host.wait()
+
+
+def main():
+    seconds = float(sys.argv[1]) if len(sys.argv) > 1 else 60
+    binary = os.path.join(HOST, "Build", "GPRS-host")
+    os.makedirs(TRACES, exist_ok=True)
+    with open(os.path.join(TRACES, "module-to-mcu.bin"), "wb") as rx, \
+            open(os.path.join(TRACES, "mcu-to-module.bin"), "wb") as tx:
+        record(binary, seconds, 0, rx, tx, 7)
+    with open(os.devnull, "wb") as rx, open(os.path.join(TRACES, "mcu-to-module-compact.bin"), "wb") as tx:
+        record(binary, seconds, 1, rx, tx, 7)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,130 @@
+/*
+ * Two-thread stress test of the SPSC ring (Utils/ringbuffer.c): a producer thread
+ * in place of the USART2 interrupt, the main thread as the protocol loop. Every
+ * byte carries a hash of its stream position, so a byte lost, duplicated or
+ * reordered anywhere in the stream shows up as a mismatch.
+ * The producer alternates rbWrite and rbReserve/rbPublish, the consumer rbRead and
+ * rbPeek/rbCommit, in chunk lengths that do not divide the small ring, so every
+ * wrap position and every full/empty edge is hit many times.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include "ringBuffer.h"
+
+#define RING_STRESS_BYTES	(64u * 1024 * 1024)
+#define RING_STRESS_SIZE	128					//power of two
+#define RING_STRESS_CHUNK	37					//largest single write or read, not a divisor of the size
+#define RING_STRESS_TIMEOUT	120					//seconds; a lost index update stalls both sides instead of failing
+
+static uint8_t ringStressBuf[RING_STRESS_SIZE];
+static rb_t ringStressRb;
+
+static uint8_t ringStressByte(uint32_t pos) {
+	return (uint8_t)((pos * 2654435761u) >> 24);
+}
+
+static void *ringStressProducer(void *arg) {
+	uint8_t chunk[RING_STRESS_CHUNK];
+	uint8_t *span;
+	uint32_t pos = 0;
+	uint32_t n;
+	uint32_t i;
+	int32_t room;
+
+	(void)arg;
+	while (pos < RING_STRESS_BYTES) {
+		n = 1 + pos % RING_STRESS_CHUNK;
+		if (n > RING_STRESS_BYTES - pos) {
+			n = RING_STRESS_BYTES - pos;
+		}
+		if (pos & 1) {
+			for (i = 0; i < n; i++) {
+				chunk[i] = ringStressByte(pos + i);
+			}
+			if (rbWrite(&ringStressRb, chunk, n) != (int32_t)n) {
+				sched_yield();					//full, rbWrite writes all or nothing
+				continue;
+			}
+		} else {
+			room = rbReserve(&ringStressRb, &span);
+			if (room <= 0) {
+				sched_yield();
+				continue;
+			}
+			if (n > (uint32_t)room) {
+				n = room;
+			}
+			for (i = 0; i < n; i++) {
+				span[i] = ringStressByte(pos + i);
+			}
+			rbPublish(&ringStressRb, n);
+		}
+		pos += n;
+	}
+	return NULL;
+}
+
+static void ringStressStalled(int sig) {
+	static const char msg[] = "ring: stalled, an index update was lost\n";
+
+	(void)sig;
+	if (write(STDOUT_FILENO, msg, sizeof(msg) - 1) < 0) {
+		_exit(2);
+	}
+	_exit(1);
+}
+
+int main(void) {
+	pthread_t producer;
+	struct timespec t0;
+	struct timespec t1;
+	uint8_t chunk[RING_STRESS_CHUNK];
+	uint8_t *span;
+	uint32_t pos = 0;
+	uint32_t errors = 0;
+	uint32_t reads = 0;
+	int32_t n;
+	int32_t i;
+	double seconds;
+
+	ringStressRb.rbCapacity = RING_STRESS_SIZE;
+	ringStressRb.rbBuff = ringStressBuf;
+	rbCreate(&ringStressRb);
+	signal(SIGALRM, ringStressStalled);
+	alarm(RING_STRESS_TIMEOUT);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	pthread_create(&producer, NULL, ringStressProducer, NULL);
+	while (pos < RING_STRESS_BYTES) {
+		if (reads++ & 1) {
+			n = rbRead(&ringStressRb, chunk, 1 + pos % RING_STRESS_CHUNK);
+			span = chunk;
+		} else {
+			n = rbPeek(&ringStressRb, &span);
+		}
+		if (n <= 0) {
+			sched_yield();
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			if (span[i] != ringStressByte(pos + i)) {
+				errors++;
+			}
+		}
+		if (span != chunk) {
+			rbCommit(&ringStressRb, n);
+		}
+		pos += n;
+	}
+	pthread_join(producer, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+	printf("ring: %u MB through a %u byte ring by two threads, %u mismatches, %.1f MB/s\n",
+		RING_STRESS_BYTES >> 20, RING_STRESS_SIZE, errors, RING_STRESS_BYTES / seconds / 1e6);
+	return errors ? 1 : 0;
+}
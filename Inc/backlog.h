@@ -0,0 +1,44 @@
+#ifndef __BACKLOG__
+#define __BACKLOG__
+
+#include <stdint.h>
+#include "gizwits_protocol.h"
+
+/*
+ * Store-and-forward queue of status reports taken while the cloud is out of
+ * reach. New snapshots go into a RAM ring; when it is full the oldest one is
+ * spilled to a ring of flash pages behind the settings store, so a long outage
+ * (or a reset in the middle of one) loses nothing until both are full. Draining
+ * always takes the oldest snapshot first: flash, then RAM. A snapshot stays
+ * queued until the cloud acknowledged it: backlogPeek to send it, backlogPop
+ * once the ACK is in. A report that was sent live and never acknowledged comes
+ * back through backlogRequeue and goes out before everything else.
+ * A flash record is a mark, the entry and its CRC16. The mark is programmed last
+ * and cleared to zero once the record was sent, so an erase is only needed when
+ * the writer wraps into a page; that erase blocks for about 20 ms.
+ */
+#define BACKLOG_RAM_COUNT		16				//snapshots held in RAM
+#define BACKLOG_FLASH_ADDR		0x0800F800		//first page of the flash ring, right behind the settings store
+#define BACKLOG_FLASH_PAGES		2				//0: RAM only, the oldest snapshot is dropped when the ring is full
+#define BACKLOG_PAGE_SIZE		1024			//STM32F103C8 flash page
+#define BACKLOG_RETURNED_COUNT	(ACK_WINDOW_SIZE + 1)	//a full window plus the report whose send evicted the oldest
+#define BACKLOG_TIME_UNKNOWN	0xFFFFFFFF		//time of a snapshot left in flash by an earlier boot, its clock is gone
+
+typedef struct
+{
+	uint32_t time;								//gizGetTimerCount when the snapshot was taken, or BACKLOG_TIME_UNKNOWN
+	devStatus_t status;
+} backlogEntry_t;
+
+extern uint32_t backlogMerged;
+extern uint32_t backlogSpilled;
+extern uint32_t backlogDropped;
+
+void backlogInit(void);
+uint16_t backlogCount(void);
+void backlogPush(uint32_t time, const devStatus_t *status, uint8_t merge);
+int8_t backlogPeek(backlogEntry_t *entry);
+int8_t backlogPop(backlogEntry_t *entry);
+void backlogRequeue(uint32_t time, const devStatus_t *status);
+
+#endif // !__BACKLOG__
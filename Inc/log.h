@@ -0,0 +1,141 @@
+#ifndef __LOG__
+#define __LOG__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Debug output on USART3 without blocking the caller. _write (printf,
+ * GIZWITS_LOG) copies into a RAM ring; DMA1 channel 2 drains it one
+ * contiguous span at a time. A write that does not fit is dropped whole
+ * and counted, so lines are never cut in half. Safe from interrupts.
+ */
+#define LOG_RING_LEN			1024			//must be a power of two
+
+#define LOG_INPUT_BASE			0x0180			//Modbus input registers: dropped writes, dropped bytes (32 bits each), high water, level, modules
+#define LOG_INPUT_COUNT			7
+#define LOG_HOLDING_BASE		0x0180			//Modbus holding registers (FC06): runtime level, runtime module mask
+#define LOG_HOLDING_COUNT		2
+
+extern volatile uint32_t logDroppedWrites;
+extern volatile uint32_t logDroppedBytes;
+extern volatile uint16_t logHighWater;			//most bytes ever waiting in the ring
+
+/*
+ * LOG(fmt, ...) is printf, or with LOG_TOKENIZED=1 a tokenized record: the
+ * format string goes to the .logfmt section, which the linker script keeps in
+ * the ELF but not in flash, and the ring gets
+ *   LOG_TOKEN_SYNC | argument count, 16-bit offset of the string in .logfmt,
+ *   each argument as 32 bits, all little-endian
+ * Tools/logdecode.py turns a USART3 capture back into text with the ELF.
+ * fmt must be a string literal with at most LOG_TOKEN_ARGS integer or pointer
+ * arguments (no float or 64-bit); %s only decodes for strings in flash.
+ * Plain printf output may be mixed in, it passes through the decoder.
+ */
+#ifndef LOG_TOKENIZED
+#define LOG_TOKENIZED			0
+#endif
+
+#define LOG_TOKEN_SYNC			0xF0			//never a byte of ASCII text
+#define LOG_TOKEN_ARGS			8
+
+#if LOG_TOKENIZED
+#define LOG(fmt, ...)			do { \
+		static const char logFmt[] __attribute__((section(".logfmt"))) = fmt; \
+		const uint32_t logArgs[] = { 0, LOG_ARGS(__VA_ARGS__) }; \
+		logToken((uint32_t)(uintptr_t)logFmt, &logArgs[1], LOG_NARGS(__VA_ARGS__)); \
+	} while (0)
+#else
+#define LOG(fmt, ...)			printf(fmt, ##__VA_ARGS__)
+#endif
+
+#define LOG_NARGS(...)			LOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(z, a1, a2, a3, a4, a5, a6, a7, a8, n, ...)	n
+#define LOG_ARGS(...)			LOG_ARGS_(LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__)
+#define LOG_ARGS_(n, ...)		LOG_ARGS__(n, ##__VA_ARGS__)
+#define LOG_ARGS__(n, ...)		LOG_ARGS_##n(__VA_ARGS__)
+#define LOG_ARG(a)				(uint32_t)(uintptr_t)(a)
+#define LOG_ARGS_0()
+#define LOG_ARGS_1(a)			LOG_ARG(a)
+#define LOG_ARGS_2(a, ...)		LOG_ARG(a), LOG_ARGS_1(__VA_ARGS__)
+#define LOG_ARGS_3(a, ...)		LOG_ARG(a), LOG_ARGS_2(__VA_ARGS__)
+#define LOG_ARGS_4(a, ...)		LOG_ARG(a), LOG_ARGS_3(__VA_ARGS__)
+#define LOG_ARGS_5(a, ...)		LOG_ARG(a), LOG_ARGS_4(__VA_ARGS__)
+#define LOG_ARGS_6(a, ...)		LOG_ARG(a), LOG_ARGS_5(__VA_ARGS__)
+#define LOG_ARGS_7(a, ...)		LOG_ARG(a), LOG_ARGS_6(__VA_ARGS__)
+#define LOG_ARGS_8(a, ...)		LOG_ARG(a), LOG_ARGS_7(__VA_ARGS__)
+
+/*
+ * LOG_ERROR(fmt, ...) .. LOG_DEBUG(fmt, ...) log for the module the source
+ * file names in LOG_MODULE (defined before the includes). A call above
+ * LOG_LEVEL_MAX is removed by the preprocessor and one outside LOG_MODULES
+ * by the compiler's constant folding; the rest also
+ * check logLevel and logModules, which Modbus can change in the field.
+ * Release builds keep errors and warnings only, so the per-packet and
+ * per-field messages cost nothing there.
+ */
+#define LOG_LEVEL_OFF			0
+#define LOG_LEVEL_ERROR			1
+#define LOG_LEVEL_WARN			2
+#define LOG_LEVEL_INFO			3
+#define LOG_LEVEL_DEBUG			4				//per packet, per byte or per field
+
+#define LOG_MODULE_MAIN			0x01
+#define LOG_MODULE_PROTOCOL		0x02			//gizwits_protocol.c
+#define LOG_MODULE_PRODUCT		0x04			//gizwits_product.c
+#define LOG_MODULE_PROFILE		0x08
+
+#ifndef LOG_LEVEL_MAX
+#ifdef RELEASE
+#define LOG_LEVEL_MAX			LOG_LEVEL_WARN
+#else
+#define LOG_LEVEL_MAX			LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#ifndef LOG_MODULES
+#define LOG_MODULES				0xFF
+#endif
+
+#ifndef LOG_MODULE
+#define LOG_MODULE				LOG_MODULE_MAIN
+#endif
+
+#define LOG_AT(level, fmt, ...)	do { \
+		if ((LOG_MODULE & (LOG_MODULES)) && (level) <= logLevel && (LOG_MODULE & logModules)) { \
+			LOG(fmt, ##__VA_ARGS__); \
+		} \
+	} while (0)
+#define LOG_NONE(fmt, ...)		do { } while (0)
+
+#if LOG_LEVEL_MAX >= LOG_LEVEL_ERROR
+#define LOG_ERROR(fmt, ...)		LOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOG_ERROR				LOG_NONE
+#endif
+#if LOG_LEVEL_MAX >= LOG_LEVEL_WARN
+#define LOG_WARN(fmt, ...)		LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_WARN				LOG_NONE
+#endif
+#if LOG_LEVEL_MAX >= LOG_LEVEL_INFO
+#define LOG_INFO(fmt, ...)		LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_INFO				LOG_NONE
+#endif
+#if LOG_LEVEL_MAX >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(fmt, ...)		LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG				LOG_NONE
+#endif
+
+extern volatile uint8_t logLevel;				//starts at LOG_LEVEL_MAX
+extern volatile uint8_t logModules;				//starts at LOG_MODULES
+
+int32_t logWrite(const uint8_t *buf, uint32_t len);
+void logToken(uint32_t token, const uint32_t *args, uint8_t count);
+void logTxCplt(void);
+int8_t logInputRegister(uint16_t addr, uint16_t *value);
+int8_t logHoldingWrite(uint16_t addr, uint16_t value);
+
+#endif // !__LOG__
@@ -0,0 +1,34 @@
+#ifndef __MODBUSBENCH__
+#define __MODBUSBENCH__
+
+#include <stdint.h>
+
+/*
+ * Replays fixed FC03/FC06/FC10 workloads through the USART1 receive slots and
+ * modbusSlave, timing every request with the DWT cycle counter, and prints
+ * p50/p99/max per workload on USART3. Only built with MODBUS_BENCH defined;
+ * call once after schedulerInit, before the main loop.
+ * decode:     modbusSlave, i.e. ModbusDecode and queueing the reply
+ * turnaround: the IDLE interrupt's copy and CRC of the frame, plus decode
+ */
+#define MODBUS_BENCH_ITERATIONS		256			//requests per workload, also the sample buffer size
+
+typedef struct
+{
+	uint32_t p50;
+	uint32_t p99;
+	uint32_t max;
+} modbusBenchStat_t;
+
+typedef struct
+{
+	const char *name;
+	uint8_t function;							//0x03, 0x06 or 0x10; 0 for the mixed workload
+	uint8_t registers;
+	modbusBenchStat_t decode;					//CPU cycles
+	modbusBenchStat_t turnaround;				//CPU cycles
+} modbusBenchResult_t;
+
+void modbusBenchRun(void);
+
+#endif // !__MODBUSBENCH__
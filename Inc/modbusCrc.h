@@ -0,0 +1,19 @@
+#ifndef __MODBUSCRC__
+#define __MODBUSCRC__
+
+#include <stdint.h>
+
+#define MODBUS_CRC_INIT		0xFFFF		//CRC16/MODBUS initial value
+#define MODBUS_CRC_RESIDUE	0x0000		//CRC over a whole frame (data + little-endian CRC) is zero when intact
+
+extern const uint16_t modbusCrcTable[256];
+
+/* Streaming form: feed one byte at a time, e.g. straight from the RX interrupt */
+static inline uint16_t modbusCrcUpdate(uint16_t crc, uint8_t data) {
+	return (crc >> 8) ^ modbusCrcTable[(crc ^ data) & 0xFF];
+}
+
+uint16_t modbusCrcBlock(uint16_t crc, const uint8_t *buf, uint16_t len);
+uint16_t modbusCrc16(const uint8_t *buf, uint16_t len);
+
+#endif // !__MODBUSCRC__
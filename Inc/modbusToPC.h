@@ -4,6 +4,8 @@
 #include "stm32f1xx_hal.h"
 #include "main.h"
 
+extern uint8_t slaveAdd;
+
 void modbusSlave();
 
 #endif // !__MODBUSTOPC__
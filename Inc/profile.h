@@ -0,0 +1,88 @@
+#ifndef __PROFILE__
+#define __PROFILE__
+
+#include <stdint.h>
+#include "stm32f1xx_hal.h"
+
+/*
+ * Named probes on the DWT cycle counter (started by schedulerInit). Each one
+ * keeps count, sum, min and max in RAM; nothing is printed on the hot path.
+ * PROFILE_SCOPE(id) at the top of a block times it until the block is left,
+ * whichever return is taken. The figures are read through Modbus input
+ * registers (modbusToPC.c) and dumped on USART3 by profileDump.
+ * Set PROFILE_ENABLED to 0 to compile every probe out.
+ */
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED				1
+#endif
+#define PROFILE_DUMP_MS				60000		//period of the USART3 dump in DEBUG builds, 0 for none
+
+#define PROFILE_INPUT_BASE			0x0100		//first Modbus input register of the probe table
+#define PROFILE_INPUT_PER_PROBE		8			//count, min, max, mean; 32 bits each, high word first
+#define PROFILE_INPUT_COUNT			(PROFILE_COUNT * PROFILE_INPUT_PER_PROBE)
+
+typedef enum
+{
+	PROFILE_MODBUS_DECODE = 0,
+	PROFILE_GIZ_GET_PACKET,
+	PROFILE_GIZ_REPORT_DATA,
+	PROFILE_FLASH_WRITE,
+	PROFILE_UART_WRITE,
+	PROFILE_ISR_SYSTICK,
+	PROFILE_ISR_TIM3,
+	PROFILE_ISR_TIM4,
+	PROFILE_ISR_USART1,
+	PROFILE_ISR_USART2,
+	PROFILE_ISR_DMA1_CH4,
+	PROFILE_ISR_DMA1_CH5,
+	PROFILE_ISR_DMA1_CH6,
+	PROFILE_ISR_DMA1_CH7,
+	PROFILE_ISR_DMA1_CH2,
+	PROFILE_ISR_USART3,
+	PROFILE_COUNT
+} profileId_t;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t min;								//CPU cycles
+	uint32_t max;
+	uint64_t sum;
+} profileProbe_t;
+
+typedef struct
+{
+	uint8_t id;
+	uint32_t start;
+} profileScope_t;
+
+extern profileProbe_t profileProbes[PROFILE_COUNT];
+
+static inline void profileRecord(uint8_t id, uint32_t cycles) {
+	profileProbe_t *probe = &profileProbes[id];
+
+	if (probe->count == 0 || cycles < probe->min) {
+		probe->min = cycles;
+	}
+	if (cycles > probe->max) {
+		probe->max = cycles;
+	}
+	probe->sum += cycles;
+	probe->count++;
+}
+
+static inline void profileLeave(profileScope_t *scope) {
+	profileRecord(scope->id, DWT->CYCCNT - scope->start);
+}
+
+#if PROFILE_ENABLED
+#define PROFILE_SCOPE(id)	profileScope_t profileScope __attribute__((cleanup(profileLeave))) = { (id), DWT->CYCCNT }
+#else
+#define PROFILE_SCOPE(id)	((void)0)
+#endif
+
+void profileReset(void);
+int8_t profileInputRegister(uint16_t addr, uint16_t *value);
+void profileDump(void);
+
+#endif // !__PROFILE__
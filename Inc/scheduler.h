@@ -0,0 +1,36 @@
+#ifndef __SCHEDULER__
+#define __SCHEDULER__
+
+#include <stdint.h>
+
+/* Task ids double as priorities: of the ready tasks the lowest id runs first, each one to completion */
+typedef enum
+{
+	SCHEDULER_TASK_MODBUS = 0,					//frame waiting in a USART1 slot
+	SCHEDULER_TASK_GIZWITS,						//bytes in the GPRS ring, plus the protocol timers
+	SCHEDULER_TASK_USER,						//localArray into the data points
+	SCHEDULER_TASK_SETTINGS,					//settled setpoints into flash
+	SCHEDULER_TASK_PROFILE,						//probe table on USART3, DEBUG builds only
+	SCHEDULER_TASK_COUNT
+} schedulerTaskId_t;
+
+typedef struct
+{
+	void (*run)(void);
+	uint32_t periodMs;							//0: runs only when signalled
+	uint32_t nextRun;							//tick of the next periodic run
+	uint32_t runs;
+	uint32_t lastCycles;						//execution time of the last run in CPU cycles
+	uint32_t worstCycles;						//worst-case execution time in CPU cycles
+} schedulerTask_t;
+
+extern schedulerTask_t schedulerTasks[SCHEDULER_TASK_COUNT];
+extern uint32_t schedulerSleeps;
+
+void schedulerInit(void);
+void schedulerAdd(schedulerTaskId_t id, void (*run)(void), uint32_t periodMs);
+void schedulerSignal(schedulerTaskId_t id);
+void schedulerTick(void);
+void schedulerDispatch(void);
+
+#endif // !__SCHEDULER__
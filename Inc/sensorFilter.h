@@ -0,0 +1,30 @@
+#ifndef __SENSORFILTER__
+#define __SENSORFILTER__
+
+#include <stdint.h>
+
+/*
+ * Prefilter for analog readings before they reach the data points and the
+ * report deadband. The mode is a settings value: high byte the kind, low byte
+ * the window in samples (2..SENSOR_FILTER_WINDOW_MAX). Every sample is kept,
+ * so a new mode takes effect at once; anything else passes samples through.
+ */
+#define SENSOR_FILTER_WINDOW_MAX	8
+
+#define SENSOR_FILTER_OFF			0x0000
+#define SENSOR_FILTER_MEAN			0x0100			//moving average
+#define SENSOR_FILTER_MEDIAN		0x0200			//moving median, drops single-sample spikes
+
+#define SENSOR_FILTER_ACTIVE(mode)	((((mode) & 0xFF00) == SENSOR_FILTER_MEAN || ((mode) & 0xFF00) == SENSOR_FILTER_MEDIAN) && \
+									 ((mode) & 0xFF) >= 2 && ((mode) & 0xFF) <= SENSOR_FILTER_WINDOW_MAX)
+
+typedef struct
+{
+	uint16_t samples[SENSOR_FILTER_WINDOW_MAX];
+	uint8_t count;								//samples held, up to SENSOR_FILTER_WINDOW_MAX
+	uint8_t next;								//slot of the next sample
+} sensorFilter_t;
+
+uint16_t sensorFilterSample(sensorFilter_t *filter, uint16_t sample, uint16_t mode);
+
+#endif // !__SENSORFILTER__
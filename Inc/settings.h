@@ -0,0 +1,55 @@
+#ifndef __SETTINGS__
+#define __SETTINGS__
+
+#include <stdint.h>
+
+/*
+ * Append-only key/value log in the last pages of flash. A change programs one
+ * 6-byte record (key, value, CRC16); a page is only erased when the active one
+ * is full and its newest values are compacted into the next page.
+ * settingsSet only marks a key dirty, settingsHandle writes the dirty keys once
+ * the changes have settled.
+ * The code image must stay below SETTINGS_BASE_ADDR; STM32F103C8_FLASH.ld leaves
+ * the last 4 KB out of FLASH for this store and the backlog.
+ */
+#define SETTINGS_BASE_ADDR		0x0800F000		//first page of the store, the old FLASH_SAVE_ADDR
+#define SETTINGS_PAGE_SIZE		1024			//STM32F103C8 flash page
+#define SETTINGS_PAGE_COUNT		2				//pages used in rotation, at least 2
+#define SETTINGS_QUIET_MS		3000			//default quiet period before dirty keys are written
+#define SETTINGS_MAX_DEFER_MS	30000			//write anyway this long after the first uncommitted change
+#define SETTINGS_MODBUS_BASE	0x0200			//key n is input register (FC04) 0x0200 + n, and holding register (FC06) past the setpoints
+
+typedef enum
+{
+	SETTINGS_KEY_WENDU_SET = 0,					//temperature setpoint, localArray[5]
+	SETTINGS_KEY_SHIDU_SET,						//humidity setpoint, localArray[6]
+	SETTINGS_KEY_DEADBAND_WENDU,				//report deadbands of the analog data points, see gizDataPointDeadband
+	SETTINGS_KEY_DEADBAND_SHIDU,
+	SETTINGS_KEY_DEADBAND_LENGSHUI,
+	SETTINGS_KEY_DEADBAND_RESHUI,
+	SETTINGS_KEY_DEADBAND_JIASHUI,
+	SETTINGS_KEY_FILTER_WENDU,					//prefilters of the same points, sensorFilter.h modes
+	SETTINGS_KEY_FILTER_SHIDU,
+	SETTINGS_KEY_FILTER_LENGSHUI,
+	SETTINGS_KEY_FILTER_RESHUI,
+	SETTINGS_KEY_FILTER_JIASHUI,
+	SETTINGS_KEY_HEARTBEAT,						//period of the full status report in seconds, see gizDevReportPolicy
+	SETTINGS_KEY_COMPACT_REPORT,				//1: status reports in the compact passthrough format, see gizCompactEncode
+	SETTINGS_KEY_COUNT
+} settingsKey_t;
+
+#define SETTINGS_KEY_NONE		0xFF
+
+extern uint32_t settingsEraseCount;
+extern uint32_t settingsCommitCount;
+extern uint16_t settingsQuietMs;
+
+int8_t settingsInit(void);
+uint16_t settingsGet(uint16_t key, uint16_t defaultValue);
+int8_t settingsSet(uint16_t key, uint16_t value);
+void settingsCommit(void);
+void settingsHandle(void);
+int8_t settingsInputRegister(uint16_t addr, uint16_t *value);
+int8_t settingsHoldingWrite(uint16_t addr, uint16_t value);
+
+#endif // !__SETTINGS__
@@ -11,7 +11,9 @@
 //FLASHʼַ
 #define STM32_FLASH_BASE 0x08000000 	//STM32 FLASHʼַ
 
+void STMFLASH_Write_NoCheck(uint32_t WriteAddr, uint16_t *pBuffer, uint16_t NumToWrite);
 void STMFLASH_Write(uint32_t WriteAddr, uint16_t *pBuffer, uint16_t NumToWrite);
+void STMFLASH_ErasePage(uint32_t PageAddr);
 void STMFLASH_Read(uint32_t ReadAddr, uint16_t *pBuffer, uint16_t NumToRead);
 
 
@@ -57,15 +57,27 @@ extern UART_HandleTypeDef huart3;
 
 /* USER CODE BEGIN Private defines */
 
-extern volatile uint8_t Usart1ReceiveState;
+#define USART1_DMA_BUFFER_SIZE	256				//circular DMA ring for USART1 RX, must be a power of two
+#define USART1_FRAME_SLOTS		2				//frame slots: the decoder works on one while the next one fills
+#define USART1_TX_SLOTS			2				//replies queued for DMA transmission
+
 extern volatile uint8_t Usart2ReceiveState;
 
 struct buffer {									//ջṹ
 	uint8_t BufferArray[256];
-	uint8_t BufferLen;
+	uint16_t BufferLen;
+	uint16_t BufferCrc;								//CRC16 of the frame, computed while it is copied out of the DMA ring
+	volatile uint8_t BufferReady;					//set by the IDLE interrupt, cleared by the decoder once the frame is consumed
 };
 
-extern struct buffer  Usart1ReceiveBuffer, Usart2ReceiveBuffer;
+extern struct buffer  Usart1ReceiveBuffer[USART1_FRAME_SLOTS], Usart2ReceiveBuffer;
+extern DMA_HandleTypeDef hdma_usart1_rx;
+extern DMA_HandleTypeDef hdma_usart1_tx;
+extern DMA_HandleTypeDef hdma_usart2_rx;
+extern DMA_HandleTypeDef hdma_usart2_tx;
+extern DMA_HandleTypeDef hdma_usart3_tx;
+extern volatile uint32_t Usart1ReceiveDropped;
+extern volatile uint32_t Usart1TransmitDropped;
 
 /* USER CODE END Private defines */
 
@@ -76,6 +88,12 @@ void MX_USART2_UART_Init(void);
 void MX_USART3_UART_Init(void);
 
 /* USER CODE BEGIN Prototypes */
+void usart1ReceiveInit(void);
+int8_t usart1TransmitQueue(uint8_t *buf, uint16_t len);
+void usart1TransmitCplt(void);
+#ifdef MODBUS_BENCH
+int8_t usart1ReceiveInject(const uint8_t *buf, uint16_t len);
+#endif
 
 /* USER CODE END Prototypes */
 
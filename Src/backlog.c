@@ -0,0 +1,260 @@
+#include "backlog.h"
+#include "stmFlash.h"
+#include "modbusCrc.h"
+#include <string.h>
+
+#define BACKLOG_MARK_QUEUED		0x5142			//record complete, not sent yet
+#define BACKLOG_MARK_SENT		0x0000			//programmed over the queued mark once drained
+#define BACKLOG_ERASED			0xFFFF
+#define BACKLOG_ENTRY_WORDS		(sizeof(backlogEntry_t) / 2)
+#define BACKLOG_RECORD_WORDS	(BACKLOG_ENTRY_WORDS + 2)	//mark, entry, CRC16 of the entry
+#define BACKLOG_PAGE_SLOTS		(BACKLOG_PAGE_SIZE / 2 / BACKLOG_RECORD_WORDS)
+#define BACKLOG_FLASH_SLOTS		(BACKLOG_PAGE_SLOTS * BACKLOG_FLASH_PAGES)
+
+static backlogEntry_t backlogRam[BACKLOG_RAM_COUNT];
+static uint8_t backlogRamHead = 0;						//oldest snapshot in RAM
+static uint8_t backlogRamCount = 0;
+static backlogEntry_t backlogReturned[BACKLOG_RETURNED_COUNT];	//reports given up unacknowledged, older than anything queued
+static uint8_t backlogReturnedHead = 0;
+static uint8_t backlogReturnedCount = 0;
+
+uint32_t backlogMerged = 0;								//snapshots folded into the newest one
+uint32_t backlogSpilled = 0;							//snapshots moved from RAM to flash
+uint32_t backlogDropped = 0;							//snapshots lost to a full queue
+
+#if BACKLOG_FLASH_PAGES
+static uint16_t backlogWriteSlot = 0;					//next flash slot to program
+static uint16_t backlogReadSlot = 0;					//oldest queued flash slot
+static uint16_t backlogFlashCount = 0;					//queued records in flash
+static uint16_t backlogFlashStale = 0;					//the oldest of them, written before the last reset
+
+static uint32_t backlogSlotAddr(uint16_t slot) {
+	return BACKLOG_FLASH_ADDR + (slot / BACKLOG_PAGE_SLOTS) * BACKLOG_PAGE_SIZE + (slot % BACKLOG_PAGE_SLOTS) * BACKLOG_RECORD_WORDS * 2;
+}
+
+static uint8_t backlogSlotUsed(uint16_t slot) {
+	const uint16_t *record = (const uint16_t *)(uintptr_t)backlogSlotAddr(slot);
+	uint8_t i;
+
+	for (i = 0; i < BACKLOG_RECORD_WORDS; i++) {
+		if (record[i] != BACKLOG_ERASED) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* 0 with the entry of a queued record, -1 for anything else: free, sent or torn */
+static int8_t backlogSlotRead(uint16_t slot, backlogEntry_t *entry) {
+	const uint16_t *record = (const uint16_t *)(uintptr_t)backlogSlotAddr(slot);
+
+	if (record[0] != BACKLOG_MARK_QUEUED) {
+		return -1;
+	}
+	memcpy(entry, &record[1], sizeof(backlogEntry_t));
+	if (record[1 + BACKLOG_ENTRY_WORDS] != modbusCrc16((uint8_t *)entry, sizeof(backlogEntry_t))) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Oldest queued record, in ring order from the write position; the write position when there is none */
+static uint16_t backlogFindOldest(void) {
+	backlogEntry_t entry;
+	uint16_t slot = backlogWriteSlot;
+	uint16_t i;
+
+	for (i = 0; i < BACKLOG_FLASH_SLOTS; i++) {
+		if (backlogSlotRead(slot, &entry) == 0) {
+			return slot;
+		}
+		slot = (slot + 1) % BACKLOG_FLASH_SLOTS;
+	}
+	return backlogWriteSlot;
+}
+
+/* Flash must be unlocked */
+static void backlogSlotClear(uint16_t slot) {
+	uint16_t mark = BACKLOG_MARK_SENT;
+
+	STMFLASH_Write_NoCheck(backlogSlotAddr(slot), &mark, 1);
+}
+
+/* Append one record, erasing the next page first when the writer enters it; that page's records are lost */
+static void backlogSpill(const backlogEntry_t *entry) {
+	backlogEntry_t old;
+	uint16_t record[BACKLOG_RECORD_WORDS];
+	uint16_t slot;
+	uint8_t used = 0;
+
+	HAL_FLASH_Unlock();
+	if (backlogWriteSlot % BACKLOG_PAGE_SLOTS == 0) {
+		for (slot = backlogWriteSlot; slot < backlogWriteSlot + BACKLOG_PAGE_SLOTS; slot++) {
+			if (backlogSlotRead(slot, &old) == 0) {
+				backlogFlashCount--;
+				backlogDropped++;
+				if (backlogFlashStale > 0) {
+					backlogFlashStale--;				//the page the writer enters holds the oldest records
+				}
+			}
+			used |= backlogSlotUsed(slot);
+		}
+		if (used) {
+			STMFLASH_ErasePage(BACKLOG_FLASH_ADDR + (backlogWriteSlot / BACKLOG_PAGE_SLOTS) * BACKLOG_PAGE_SIZE);
+		}
+	}
+
+	memcpy(&record[1], entry, sizeof(backlogEntry_t));
+	record[1 + BACKLOG_ENTRY_WORDS] = modbusCrc16((uint8_t *)entry, sizeof(backlogEntry_t));
+	STMFLASH_Write_NoCheck(backlogSlotAddr(backlogWriteSlot) + 2, &record[1], BACKLOG_RECORD_WORDS - 1);
+	record[0] = BACKLOG_MARK_QUEUED;
+	STMFLASH_Write_NoCheck(backlogSlotAddr(backlogWriteSlot), record, 1);
+	HAL_FLASH_Lock();
+
+	backlogWriteSlot = (backlogWriteSlot + 1) % BACKLOG_FLASH_SLOTS;
+	backlogFlashCount++;
+	backlogSpilled++;
+	backlogReadSlot = backlogFindOldest();
+}
+#endif // BACKLOG_FLASH_PAGES
+
+/**
+  * Pick up the records a reset left in flash. The writer resumes after the
+  * last used slot, found as the first free slot that follows a used one.
+  */
+void backlogInit(void) {
+#if BACKLOG_FLASH_PAGES
+	backlogEntry_t entry;
+	uint16_t slot;
+
+	backlogWriteSlot = 0;
+	backlogFlashCount = 0;
+	for (slot = 0; slot < BACKLOG_FLASH_SLOTS; slot++) {
+		if (!backlogSlotUsed(slot) && backlogSlotUsed((slot + BACKLOG_FLASH_SLOTS - 1) % BACKLOG_FLASH_SLOTS)) {
+			backlogWriteSlot = slot;
+		}
+		if (backlogSlotRead(slot, &entry) == 0) {
+			backlogFlashCount++;
+		}
+	}
+	backlogReadSlot = backlogFindOldest();
+	backlogFlashStale = backlogFlashCount;
+#endif
+	backlogRamHead = 0;
+	backlogRamCount = 0;
+	backlogReturnedHead = 0;
+	backlogReturnedCount = 0;
+}
+
+uint16_t backlogCount(void) {
+#if BACKLOG_FLASH_PAGES
+	return backlogReturnedCount + backlogRamCount + backlogFlashCount;
+#else
+	return backlogReturnedCount + backlogRamCount;
+#endif
+}
+
+/**
+  * Queue a snapshot. With merge set it replaces the newest snapshot still in
+  * RAM instead, for changes that only move a level and need not be replayed.
+  */
+void backlogPush(uint32_t time, const devStatus_t *status, uint8_t merge) {
+	backlogEntry_t *entry;
+
+	if (merge && backlogRamCount > 0) {
+		entry = &backlogRam[(backlogRamHead + backlogRamCount - 1) % BACKLOG_RAM_COUNT];
+		entry->time = time;
+		memcpy(&entry->status, status, sizeof(devStatus_t));
+		backlogMerged++;
+		return;
+	}
+
+	if (backlogRamCount == BACKLOG_RAM_COUNT) {
+#if BACKLOG_FLASH_PAGES
+		backlogSpill(&backlogRam[backlogRamHead]);
+#else
+		backlogDropped++;
+#endif
+		backlogRamHead = (backlogRamHead + 1) % BACKLOG_RAM_COUNT;
+		backlogRamCount--;
+	}
+
+	entry = &backlogRam[(backlogRamHead + backlogRamCount) % BACKLOG_RAM_COUNT];
+	entry->time = time;
+	memcpy(&entry->status, status, sizeof(devStatus_t));
+	backlogRamCount++;
+}
+
+/* Copy the oldest snapshot without taking it. Returns 0 with it, -1 when the queue is empty */
+int8_t backlogPeek(backlogEntry_t *entry) {
+	if (backlogReturnedCount > 0) {
+		memcpy(entry, &backlogReturned[backlogReturnedHead], sizeof(backlogEntry_t));
+		return 0;
+	}
+#if BACKLOG_FLASH_PAGES
+	if (backlogFlashCount > 0) {
+		if (backlogSlotRead(backlogReadSlot, entry) != 0) {
+			return -1;
+		}
+		if (backlogFlashStale > 0) {
+			entry->time = BACKLOG_TIME_UNKNOWN;
+		}
+		return 0;
+	}
+#endif
+	if (backlogRamCount == 0) {
+		return -1;
+	}
+	memcpy(entry, &backlogRam[backlogRamHead], sizeof(backlogEntry_t));
+	return 0;
+}
+
+/* Take the oldest snapshot. Returns 0 with it, -1 when the queue is empty */
+int8_t backlogPop(backlogEntry_t *entry) {
+	if (backlogReturnedCount > 0) {
+		memcpy(entry, &backlogReturned[backlogReturnedHead], sizeof(backlogEntry_t));
+		backlogReturnedHead = (backlogReturnedHead + 1) % BACKLOG_RETURNED_COUNT;
+		backlogReturnedCount--;
+		return 0;
+	}
+#if BACKLOG_FLASH_PAGES
+	if (backlogFlashCount > 0) {
+		backlogSlotRead(backlogReadSlot, entry);
+		HAL_FLASH_Unlock();
+		backlogSlotClear(backlogReadSlot);
+		HAL_FLASH_Lock();
+		backlogFlashCount--;
+		backlogReadSlot = backlogFindOldest();
+		if (backlogFlashStale > 0) {
+			entry->time = BACKLOG_TIME_UNKNOWN;
+			backlogFlashStale--;
+		}
+		return 0;
+	}
+#endif
+	if (backlogRamCount == 0) {
+		return -1;
+	}
+	memcpy(entry, &backlogRam[backlogRamHead], sizeof(backlogEntry_t));
+	backlogRamHead = (backlogRamHead + 1) % BACKLOG_RAM_COUNT;
+	backlogRamCount--;
+	return 0;
+}
+
+/**
+  * Queue again a report that was sent but given up without an ACK. Reports only go
+  * out live while the queue is empty, so it is older than anything queued and is
+  * sent first; several go back in the order they were sent.
+  */
+void backlogRequeue(uint32_t time, const devStatus_t *status) {
+	backlogEntry_t *entry;
+
+	if (backlogReturnedCount == BACKLOG_RETURNED_COUNT) {
+		backlogDropped++;
+		return;
+	}
+	entry = &backlogReturned[(backlogReturnedHead + backlogReturnedCount) % BACKLOG_RETURNED_COUNT];
+	entry->time = time;
+	memcpy(&entry->status, status, sizeof(devStatus_t));
+	backlogReturnedCount++;
+}
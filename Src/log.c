@@ -0,0 +1,131 @@
+#include "log.h"
+#include "usart.h"
+#include <string.h>
+
+static uint8_t logRing[LOG_RING_LEN];
+static volatile uint32_t logHead = 0;			//bytes written into the ring so far
+static volatile uint32_t logTail = 0;			//bytes sent out by the DMA so far
+static volatile uint16_t logBusyLen = 0;		//length of the span on the wire, 0 when idle
+
+volatile uint32_t logDroppedWrites = 0;
+volatile uint32_t logDroppedBytes = 0;
+volatile uint16_t logHighWater = 0;
+volatile uint8_t logLevel = LOG_LEVEL_MAX;
+volatile uint8_t logModules = LOG_MODULES;
+
+/* Start the DMA on the oldest contiguous span; call with interrupts disabled or from the USART3 interrupt */
+static void logKick(void) {
+	uint32_t pos;
+	uint32_t span;
+
+	if (logBusyLen != 0 || logHead == logTail) {
+		return;
+	}
+
+	pos = logTail & (LOG_RING_LEN - 1);
+	span = logHead - logTail;
+	if (span > LOG_RING_LEN - pos) {
+		span = LOG_RING_LEN - pos;
+	}
+
+	logBusyLen = span;
+	if (HAL_UART_Transmit_DMA(&huart3, &logRing[pos], span) != HAL_OK) {
+		logBusyLen = 0;							//port not initialised yet, the next write retries
+	}
+}
+
+/**
+  * Queue bytes for USART3 and return at once.
+  * Returns len, or -1 when they did not fit and were dropped.
+  */
+int32_t logWrite(const uint8_t *buf, uint32_t len) {
+	uint32_t primask;
+	uint32_t head;
+	uint32_t pos;
+	uint32_t first;
+	uint32_t used;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if (len > LOG_RING_LEN - (logHead - logTail)) {
+		logDroppedWrites++;
+		logDroppedBytes += len;
+		__set_PRIMASK(primask);
+		return -1;
+	}
+
+	head = logHead;
+	pos = head & (LOG_RING_LEN - 1);
+	first = (len < LOG_RING_LEN - pos) ? len : LOG_RING_LEN - pos;
+	memcpy(&logRing[pos], buf, first);
+	memcpy(logRing, buf + first, len - first);
+	logHead = head + len;
+
+	used = logHead - logTail;
+	if (used > logHighWater) {
+		logHighWater = used;
+	}
+	logKick();
+	__set_PRIMASK(primask);
+	return len;
+}
+
+/* Tokenized record of LOG with LOG_TOKENIZED=1, see log.h */
+void logToken(uint32_t token, const uint32_t *args, uint8_t count) {
+	uint8_t record[3 + LOG_TOKEN_ARGS * 4];
+
+	record[0] = LOG_TOKEN_SYNC | count;
+	record[1] = token & 0xFF;
+	record[2] = (token >> 8) & 0xFF;
+	memcpy(&record[3], args, count * 4);		//both targets are little-endian
+	logWrite(record, 3 + count * 4);
+}
+
+/* Called from HAL_UART_TxCpltCallback when a span has left USART3 */
+void logTxCplt(void) {
+	logTail += logBusyLen;
+	logBusyLen = 0;
+	logKick();
+}
+
+int8_t logInputRegister(uint16_t addr, uint16_t *value) {
+	uint32_t field;
+
+	if (addr < LOG_INPUT_BASE || addr >= LOG_INPUT_BASE + LOG_INPUT_COUNT) {
+		return -1;
+	}
+	switch (addr - LOG_INPUT_BASE) {
+	case 0:
+	case 1:
+		field = logDroppedWrites;
+		break;
+	case 2:
+	case 3:
+		field = logDroppedBytes;
+		break;
+	case 4:
+		*value = logHighWater;
+		return 0;
+	case 5:
+		*value = logLevel;
+		return 0;
+	default:
+		*value = logModules;
+		return 0;
+	}
+	*value = ((addr - LOG_INPUT_BASE) & 1) ? (field & 0xFFFF) : (field >> 16);
+	return 0;
+}
+
+/* FC06 on the runtime filter; levels above LOG_LEVEL_MAX are accepted but have nothing compiled in to show */
+int8_t logHoldingWrite(uint16_t addr, uint16_t value) {
+	if (addr < LOG_HOLDING_BASE || addr >= LOG_HOLDING_BASE + LOG_HOLDING_COUNT || value > 0xFF) {
+		return -1;
+	}
+	if (addr == LOG_HOLDING_BASE) {
+		logLevel = value;
+	} else {
+		logModules = value;
+	}
+	return 0;
+}
@@ -39,6 +39,7 @@
 #include "main.h"
 #include "stm32f1xx_hal.h"
 #include "tim.h"
+#include "dma.h"
 #include "usart.h"
 #include "gpio.h"
 
@@ -47,8 +48,12 @@
 #include "gizwits_product.h"
 #include "modbusToPC.h"
 #include "stmFlash.h"
+#include "settings.h"
+#include "scheduler.h"
+#include "modbusBench.h"
+#include "profile.h"
 
-#define GIZWITS_LOG printf
+#define GIZWITS_LOG LOG_INFO
 
 
 /* USER CODE END Includes */
@@ -69,7 +74,14 @@ void SystemClock_Config(void);
 /* USER CODE END PFP */
 
 /* USER CODE BEGIN 0 */
-
+static void gizwitsTask(void)
+{
+	gizwitsHandle((dataPoint_t *)&currentDataPoint);
+	if (rbCanRead(&pRb) > 0)
+	{
+		schedulerSignal(SCHEDULER_TASK_GIZWITS);		//one packet per run, come back for the rest
+	}
+}
 /* USER CODE END 0 */
 
 int main(void)
@@ -100,6 +112,7 @@ int main(void)
   HAL_GPIO_WritePin(G510_ON_GPIO_Port, G510_ON_Pin, GPIO_PIN_RESET);
   HAL_Delay(1000);
   HAL_GPIO_WritePin(G510_ON_GPIO_Port, G510_ON_Pin, GPIO_PIN_SET);
+  MX_DMA_Init();
   MX_USART1_UART_Init();
   MX_USART2_UART_Init();
   MX_USART3_UART_Init();
@@ -107,12 +120,25 @@ int main(void)
   MX_TIM3_Init();
 
   /* USER CODE BEGIN 2 */
-  uartInit(); //ڳʼ
+  usart1ReceiveInit();
   timerInit();//ʱʼ
   userInit();
   gizwitsInit();
+  uartInit(); //ڳʼ
   GIZWITS_LOG("MCU Init Success \n");
 
+  schedulerInit();
+  schedulerAdd(SCHEDULER_TASK_MODBUS, modbusSlave, 0);
+  schedulerAdd(SCHEDULER_TASK_GIZWITS, gizwitsTask, 10);
+  schedulerAdd(SCHEDULER_TASK_USER, userHandle, 10);
+  schedulerAdd(SCHEDULER_TASK_SETTINGS, settingsHandle, 100);
+#if defined(DEBUG) && PROFILE_DUMP_MS
+  schedulerAdd(SCHEDULER_TASK_PROFILE, profileDump, PROFILE_DUMP_MS);
+#endif
+#ifdef MODBUS_BENCH
+  modbusBenchRun();
+#endif
+
  
   /* USER CODE END 2 */
 
@@ -123,9 +149,7 @@ int main(void)
   /* USER CODE END WHILE */
 
   /* USER CODE BEGIN 3 */
-	  userHandle();
-	  modbusSlave();
-	  gizwitsHandle((dataPoint_t *)&currentDataPoint);
+	  schedulerDispatch();
   }
   /* USER CODE END 3 */
 
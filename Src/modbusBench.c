@@ -0,0 +1,179 @@
+#include "modbusBench.h"
+
+#ifdef MODBUS_BENCH
+#include "modbusToPC.h"
+#include "modbusCrc.h"
+#include "usart.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MODBUS_BENCH_WRITE_REG		0x10		//FC06/FC10 target, above the registers the application uses
+
+static const struct
+{
+	const char *name;
+	uint8_t function;
+	uint8_t registers;
+} modbusBenchWorkloads[] = {
+	{ "FC03 x1", 0x03, 1 },
+	{ "FC03 x8", 0x03, 8 },
+	{ "FC03 x32", 0x03, 32 },
+	{ "FC06", 0x06, 1 },
+	{ "FC10 x1", 0x10, 1 },
+	{ "FC10 x8", 0x10, 8 },
+	{ "FC10 x16", 0x10, 16 },
+	{ "mixed", 0, 0 },							//random pick of the ones above, must stay last
+};
+
+#define MODBUS_BENCH_WORKLOADS		(sizeof(modbusBenchWorkloads) / sizeof(modbusBenchWorkloads[0]))
+
+modbusBenchResult_t modbusBenchResults[MODBUS_BENCH_WORKLOADS];
+
+static uint32_t modbusBenchDecode[MODBUS_BENCH_ITERATIONS];
+static uint32_t modbusBenchTurnaround[MODBUS_BENCH_ITERATIONS];
+static uint32_t modbusBenchSeed = 0x2545F491;
+
+static uint32_t modbusBenchRandom(void) {
+	modbusBenchSeed ^= modbusBenchSeed << 13;
+	modbusBenchSeed ^= modbusBenchSeed >> 17;
+	modbusBenchSeed ^= modbusBenchSeed << 5;
+	return modbusBenchSeed;
+}
+
+/* A request as a master would send it, CRC included */
+static uint16_t modbusBenchFrame(uint8_t *frame, uint8_t function, uint8_t registers, uint16_t value) {
+	uint16_t len = 0;
+	uint16_t crc;
+	uint8_t i;
+
+	frame[len++] = slaveAdd;
+	frame[len++] = function;
+	frame[len++] = 0x00;
+	switch (function) {
+	case 0x03:
+		frame[len++] = 0x00;
+		frame[len++] = 0x00;
+		frame[len++] = registers;
+		break;
+
+	case 0x06:
+		frame[len++] = MODBUS_BENCH_WRITE_REG;
+		frame[len++] = value >> 8;
+		frame[len++] = value & 0xFF;
+		break;
+
+	case 0x10:
+		frame[len++] = MODBUS_BENCH_WRITE_REG;
+		frame[len++] = 0x00;
+		frame[len++] = registers;
+		frame[len++] = registers * 2;
+		for (i = 0; i < registers; i++) {
+			frame[len++] = value >> 8;
+			frame[len++] = (value + i) & 0xFF;
+		}
+		break;
+	}
+	crc = modbusCrc16(frame, len);
+	frame[len++] = crc & 0xFF;
+	frame[len++] = crc >> 8;
+	return len;
+}
+
+static void modbusBenchSort(uint32_t *samples, uint16_t count) {
+	uint16_t i;
+	uint16_t j;
+	uint32_t value;
+
+	for (i = 1; i < count; i++) {
+		value = samples[i];
+		for (j = i; j > 0 && samples[j - 1] > value; j--) {
+			samples[j] = samples[j - 1];
+		}
+		samples[j] = value;
+	}
+}
+
+static void modbusBenchStat(modbusBenchStat_t *stat, uint32_t *samples, uint16_t count) {
+	modbusBenchSort(samples, count);
+	stat->p50 = samples[count / 2];
+	stat->p99 = samples[(uint32_t)count * 99 / 100];
+	stat->max = samples[count - 1];
+}
+
+/* Cycles as microseconds with one decimal */
+static void modbusBenchPrint(const char *label, modbusBenchStat_t *stat, uint32_t mhz) {
+	printf(" %s p50 %lu (%lu.%luus) p99 %lu (%lu.%luus) max %lu (%lu.%luus)", label,
+		(unsigned long)stat->p50, (unsigned long)(stat->p50 / mhz), (unsigned long)(stat->p50 * 10 / mhz % 10),
+		(unsigned long)stat->p99, (unsigned long)(stat->p99 / mhz), (unsigned long)(stat->p99 * 10 / mhz % 10),
+		(unsigned long)stat->max, (unsigned long)(stat->max / mhz), (unsigned long)(stat->max * 10 / mhz % 10));
+}
+
+/**
+  * Runs every workload MODBUS_BENCH_ITERATIONS times. Interrupts stay enabled,
+  * so the tails include the ISR load of an idle system; the Modbus line
+  * should be quiet while it runs.
+  */
+void modbusBenchRun(void) {
+	static uint8_t frame[256];
+	modbusBenchResult_t *result;
+	uint32_t mhz = HAL_RCC_GetHCLKFreq() / 1000000;
+	uint32_t savedState;
+	uint32_t start;
+	uint32_t decoded;
+	uint32_t end;
+	uint64_t total;
+	uint16_t len;
+	uint16_t i;
+	uint8_t w;
+	uint8_t pick;
+
+	savedState = huart1.gState;
+	huart1.gState = HAL_UART_STATE_BUSY_TX;			//replies stay queued, nothing goes out on the line
+
+	printf("modbus bench: %u requests per workload, CPU cycles at %lu MHz\n", MODBUS_BENCH_ITERATIONS, (unsigned long)mhz);
+	for (w = 0; w < MODBUS_BENCH_WORKLOADS; w++) {
+		result = &modbusBenchResults[w];
+		result->name = modbusBenchWorkloads[w].name;
+		result->function = modbusBenchWorkloads[w].function;
+		result->registers = modbusBenchWorkloads[w].registers;
+		total = 0;
+
+		for (i = 0; i < MODBUS_BENCH_ITERATIONS; i++) {
+			pick = w;
+			if (modbusBenchWorkloads[w].function == 0) {
+				pick = modbusBenchRandom() % (MODBUS_BENCH_WORKLOADS - 1);
+			}
+			len = modbusBenchFrame(frame, modbusBenchWorkloads[pick].function,
+				modbusBenchWorkloads[pick].registers, (uint16_t)modbusBenchRandom());
+
+			start = DWT->CYCCNT;
+			if (usart1ReceiveInject(frame, len) != 0) {
+				modbusSlave();							//a real frame got in first, drain and retry
+				start = DWT->CYCCNT;
+				usart1ReceiveInject(frame, len);
+			}
+			decoded = DWT->CYCCNT;
+			modbusSlave();
+			end = DWT->CYCCNT;
+			usart1TransmitCplt();						//retire the reply as if it had been sent
+
+			modbusBenchDecode[i] = end - decoded;
+			modbusBenchTurnaround[i] = end - start;
+			total += end - start;
+		}
+
+		modbusBenchStat(&result->decode, modbusBenchDecode, MODBUS_BENCH_ITERATIONS);
+		modbusBenchStat(&result->turnaround, modbusBenchTurnaround, MODBUS_BENCH_ITERATIONS);
+		printf("%-9s", result->name);
+		modbusBenchPrint("decode", &result->decode, mhz);
+		modbusBenchPrint(" | turnaround", &result->turnaround, mhz);
+		printf(" | %lu req/s\n", (unsigned long)((uint64_t)HAL_RCC_GetHCLKFreq() * MODBUS_BENCH_ITERATIONS / (total ? total : 1)));
+	}
+
+	huart1.gState = savedState;
+#ifdef HOST_BUILD
+	exit(0);										//Host/Makefile bench target: the numbers are all it wants
+#endif
+}
+
+#endif // MODBUS_BENCH
@@ -1,39 +1,47 @@
 #include "modbusToPC.h"
 #include "usart.h"
 #include "gizwits_product.h"
+#include "modbusCrc.h"
+#include "profile.h"
+#include "log.h"
+#include "settings.h"
 
 uint8_t slaveAdd = 1;
 
-static uint16_t GetCRC16(uint8_t *arr_buff, uint8_t len) {  //CRCУ
-	uint16_t crc = 0xFFFF;
-	uint8_t i, j;
-	for (j = 0; j < len; j++) {
-		crc = crc ^*arr_buff++;
-		for (i = 0; i < 8; i++) {
-			if ((crc & 0x0001) > 0) {
-				crc = crc >> 1;
-				crc = crc ^ 0xa001;
-			}
-			else
-				crc = crc >> 1;
-		}
+#define MODBUS_INPUT_MAX	125									//registers per FC04 request, the reply fills MDbuf
+
+/* Read-only input registers for FC04, each table answers for its own window */
+static int8_t modbusInputRegister(uint16_t addr, uint16_t *value) {
+	if (profileInputRegister(addr, value) == 0) {
+		return 0;
+	}
+	if (settingsInputRegister(addr, value) == 0) {
+		return 0;
 	}
-	return (crc);
+	if (gizwitsInputRegister(addr, value) == 0) {
+		return 0;
+	}
+	return logInputRegister(addr, value);
 }
 
+/* FC06 outside the localArray window: runtime switches that are not application data */
+static int8_t modbusHoldingWrite(uint16_t addr, uint16_t value) {
+	if (settingsHoldingWrite(addr, value) == 0) {
+		return 0;
+	}
+	return logHoldingWrite(addr, value);
+}
 
-static void ModbusDecode(unsigned char *MDbuf, unsigned char len) {
+static void ModbusDecode(unsigned char *MDbuf, uint16_t len, uint16_t rxCrc) {
 
 	unsigned char i;
 	unsigned char cnt;
 	unsigned int  crc;
-	unsigned char crch, crcl;
+	PROFILE_SCOPE(PROFILE_MODBUS_DECODE);
 
+	if (len < 4) return;										//address + function code + CRC at least
 	if (MDbuf[0] != slaveAdd) return;								//ַʱٶԱ֡ݽУ
-	crc = GetCRC16(MDbuf, len - 2);								//CRCУֵ
-	crch = crc >> 8;
-	crcl = crc & 0xFF;
-	if ((MDbuf[len - 1] != crch) || (MDbuf[len - 2] != crcl)) return;	//CRCУ鲻ʱֱ˳
+	if (rxCrc != MODBUS_CRC_RESIDUE) return;							//CRCУ鲻ʱֱ˳
 	switch (MDbuf[1]) {											//ַУ־󣬽룬ִز
 
 	case 0x03:											//ȡһļĴ
@@ -55,12 +63,42 @@ static void ModbusDecode(unsigned char *MDbuf, unsigned char len) {
 		}
 		break;
 
+	case 0x04:											//input registers, diagnostics only
+		{
+			uint16_t addr = (MDbuf[2] << 8) | MDbuf[3];
+			uint16_t count = (MDbuf[4] << 8) | MDbuf[5];
+			uint16_t value;
+
+			if ((count == 0) || (count > MODBUS_INPUT_MAX)) {
+				MDbuf[1] = 0x84;
+				MDbuf[2] = 0x03;							//03: invalid quantity
+				len = 3;
+				break;
+			}
+			MDbuf[2] = count * 2;
+			len = 3;
+			while (count--) {
+				if (modbusInputRegister(addr++, &value) != 0) {
+					MDbuf[1] = 0x84;
+					MDbuf[2] = 0x02;						//02: invalid address
+					len = 3;
+					break;
+				}
+				MDbuf[len++] = value >> 8;
+				MDbuf[len++] = value & 0xff;
+			}
+		}
+		break;
+
 	case 0x06:											//д뵥Ĵ
 		if ((MDbuf[2] == 0x00) && (MDbuf[3] <= 0x20)) {	//Ĵַ֧0x00000x0020
 			i = MDbuf[3];								//ȡĴַ
 			localArray[i] = MDbuf[5];				//Ĵ
 			len -= 2;									//-2¼CRCԭ֡
 		}
+		else if (modbusHoldingWrite((MDbuf[2] << 8) | MDbuf[3], (MDbuf[4] << 8) | MDbuf[5]) == 0) {
+			len -= 2;									//echo the request, as above
+		}
 		else {					//Ĵַ֧ʱش{
 			MDbuf[1] = 0x86;	//λ1
 			MDbuf[2] = 0x02;	//쳣Ϊ02-Чַ
@@ -96,17 +134,21 @@ static void ModbusDecode(unsigned char *MDbuf, unsigned char len) {
 		len = 3;
 		break;
 	}
-	crc = GetCRC16(MDbuf, len);		//㷵֡CRCУֵ
+	crc = modbusCrc16(MDbuf, len);		//㷵֡CRCУֵ
 	MDbuf[len++] = crc & 0xFF;		//CRCֽ
 	MDbuf[len++] = crc >> 8;		//CRCֽ
-	HAL_UART_Transmit(&huart1, MDbuf, len, 0xff);	//ͷ֡
+	usart1TransmitQueue(MDbuf, len);				//ͷ֡
 }
 
 void modbusSlave() {
-	if (Usart1ReceiveState)
+	static uint8_t decodeSlot = 0;
+	struct buffer *frame = &Usart1ReceiveBuffer[decodeSlot];
+
+	while (frame->BufferReady)
 	{
-		Usart1ReceiveState = 0;
-		ModbusDecode(Usart1ReceiveBuffer.BufferArray, Usart1ReceiveBuffer.BufferLen);
-		Usart1ReceiveBuffer.BufferLen = 0;
+		ModbusDecode(frame->BufferArray, frame->BufferLen, frame->BufferCrc);
+		frame->BufferReady = 0;							//slot goes back to the IDLE interrupt
+		decodeSlot = (decodeSlot + 1) % USART1_FRAME_SLOTS;
+		frame = &Usart1ReceiveBuffer[decodeSlot];
 	}
 }
\ No newline at end of file
@@ -0,0 +1,84 @@
+#define LOG_MODULE LOG_MODULE_PROFILE
+#include "profile.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+
+profileProbe_t profileProbes[PROFILE_COUNT];
+
+static const char *const profileNames[PROFILE_COUNT] = {
+	"ModbusDecode",
+	"gizProtocolGetOnePacket",
+	"gizDataPoints2ReportData",
+	"STMFLASH_Write",
+	"uartWrite",
+	"SysTick_Handler",
+	"TIM3_IRQHandler",
+	"TIM4_IRQHandler",
+	"USART1_IRQHandler",
+	"USART2_IRQHandler",
+	"DMA1_Channel4_IRQHandler",
+	"DMA1_Channel5_IRQHandler",
+	"DMA1_Channel6_IRQHandler",
+	"DMA1_Channel7_IRQHandler",
+	"DMA1_Channel2_IRQHandler",
+	"USART3_IRQHandler",
+};
+
+void profileReset(void) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	memset(profileProbes, 0, sizeof(profileProbes));
+	__set_PRIMASK(primask);
+}
+
+/**
+  * One input register of the probe table, for FC04.
+  * Returns 0 with the value, -1 when addr is outside the table.
+  */
+int8_t profileInputRegister(uint16_t addr, uint16_t *value) {
+	profileProbe_t *probe;
+	uint32_t field;
+	uint16_t offset;
+
+	if (addr < PROFILE_INPUT_BASE || addr >= PROFILE_INPUT_BASE + PROFILE_INPUT_COUNT) {
+		return -1;
+	}
+	offset = addr - PROFILE_INPUT_BASE;
+	probe = &profileProbes[offset / PROFILE_INPUT_PER_PROBE];
+	switch ((offset % PROFILE_INPUT_PER_PROBE) / 2) {
+	case 0:
+		field = probe->count;
+		break;
+	case 1:
+		field = probe->min;
+		break;
+	case 2:
+		field = probe->max;
+		break;
+	default:
+		field = probe->count ? (uint32_t)(probe->sum / probe->count) : 0;
+		break;
+	}
+	*value = (offset & 1) ? (field & 0xFFFF) : (field >> 16);
+	return 0;
+}
+
+/* Output on USART3 through LOG, run it from a low priority task only */
+void profileDump(void) {
+	profileProbe_t probe;
+	uint32_t primask;
+	uint8_t id;
+
+	LOG_INFO("profile: cycles at %lu MHz\n", (unsigned long)(HAL_RCC_GetHCLKFreq() / 1000000));
+	for (id = 0; id < PROFILE_COUNT; id++) {
+		primask = __get_PRIMASK();
+		__disable_irq();
+		probe = profileProbes[id];					//consistent copy, an ISR may update it
+		__set_PRIMASK(primask);
+
+		LOG_INFO("%-26s count %10lu min %8lu mean %8lu max %8lu\n", profileNames[id], (unsigned long)probe.count,
+			(unsigned long)probe.min, (unsigned long)(probe.count ? probe.sum / probe.count : 0), (unsigned long)probe.max);
+	}
+}
@@ -0,0 +1,83 @@
+#include "scheduler.h"
+#include "stm32f1xx_hal.h"
+#include <string.h>
+
+schedulerTask_t schedulerTasks[SCHEDULER_TASK_COUNT];
+uint32_t schedulerSleeps = 0;						//times the main loop found nothing to do and slept
+
+static volatile uint32_t schedulerReady = 0;		//one ready flag per task id
+
+/* Starts the DWT cycle counter used for the execution time figures */
+void schedulerInit(void) {
+	memset(schedulerTasks, 0, sizeof(schedulerTasks));
+	schedulerReady = 0;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void schedulerAdd(schedulerTaskId_t id, void (*run)(void), uint32_t periodMs) {
+	schedulerTasks[id].run = run;
+	schedulerTasks[id].periodMs = periodMs;
+	schedulerTasks[id].nextRun = HAL_GetTick() + periodMs;
+	schedulerSignal(id);								//first run straight away
+}
+
+/* Callable from interrupts and from tasks */
+void schedulerSignal(schedulerTaskId_t id) {
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	schedulerReady |= 1u << id;
+	__set_PRIMASK(primask);
+}
+
+/* Called from SysTick_Handler every millisecond: flags the periodic tasks that are due */
+void schedulerTick(void) {
+	uint32_t now = HAL_GetTick();
+	uint8_t id;
+
+	for (id = 0; id < SCHEDULER_TASK_COUNT; id++) {
+		if (schedulerTasks[id].periodMs != 0 && (int32_t)(now - schedulerTasks[id].nextRun) >= 0) {
+			schedulerTasks[id].nextRun = now + schedulerTasks[id].periodMs;
+			schedulerReady |= 1u << id;
+		}
+	}
+}
+
+/**
+  * Call from the main loop. Runs the highest priority ready task, or sleeps
+  * until the next interrupt when none is ready.
+  */
+void schedulerDispatch(void) {
+	schedulerTask_t *task;
+	uint32_t ready;
+	uint32_t start;
+	uint8_t id;
+
+	__disable_irq();
+	ready = schedulerReady;
+	if (ready == 0) {
+		schedulerSleeps++;
+		__WFI();										//a pending interrupt wakes the core even with PRIMASK set, so no signal is lost
+		__enable_irq();
+		return;
+	}
+	id = __builtin_ctz(ready);
+	schedulerReady = ready & ~(1u << id);
+	__enable_irq();
+
+	task = &schedulerTasks[id];
+	if (task->run == NULL) {
+		return;
+	}
+
+	start = DWT->CYCCNT;
+	task->run();
+	task->lastCycles = DWT->CYCCNT - start;
+	if (task->lastCycles > task->worstCycles) {
+		task->worstCycles = task->lastCycles;
+	}
+	task->runs++;
+}
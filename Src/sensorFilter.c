@@ -0,0 +1,50 @@
+#include "sensorFilter.h"
+
+/* Adds the sample and returns the filtered value under mode */
+uint16_t sensorFilterSample(sensorFilter_t *filter, uint16_t sample, uint16_t mode) {
+	uint16_t window[SENSOR_FILTER_WINDOW_MAX];
+	uint8_t len = mode & 0xFF;
+	uint8_t pos;
+	uint8_t i;
+	uint8_t j;
+	uint32_t sum;
+	uint16_t value;
+
+	filter->samples[filter->next] = sample;
+	filter->next = (filter->next + 1) % SENSOR_FILTER_WINDOW_MAX;
+	if (filter->count < SENSOR_FILTER_WINDOW_MAX) {
+		filter->count++;
+	}
+
+	if (!SENSOR_FILTER_ACTIVE(mode)) {
+		return sample;
+	}
+	if (len > filter->count) {
+		len = filter->count;						//too few samples yet
+	}
+
+	pos = filter->next;
+	switch (mode & 0xFF00) {
+	case SENSOR_FILTER_MEAN:
+		sum = 0;
+		for (i = 0; i < len; i++) {
+			pos = (pos + SENSOR_FILTER_WINDOW_MAX - 1) % SENSOR_FILTER_WINDOW_MAX;
+			sum += filter->samples[pos];
+		}
+		return (sum + len / 2) / len;
+
+	case SENSOR_FILTER_MEDIAN:
+		for (i = 0; i < len; i++) {					//newest len samples, insertion sorted
+			pos = (pos + SENSOR_FILTER_WINDOW_MAX - 1) % SENSOR_FILTER_WINDOW_MAX;
+			value = filter->samples[pos];
+			for (j = i; j > 0 && window[j - 1] > value; j--) {
+				window[j] = window[j - 1];
+			}
+			window[j] = value;
+		}
+		return (len & 1) ? window[len / 2] : (window[len / 2 - 1] + window[len / 2] + 1) / 2;
+
+	default:
+		return sample;
+	}
+}
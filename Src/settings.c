@@ -0,0 +1,240 @@
+#include "settings.h"
+#include "stmFlash.h"
+#include "modbusCrc.h"
+#include <string.h>
+
+#define SETTINGS_MAGIC			0x5354			//marks a page whose header was completed
+#define SETTINGS_HEADER_WORDS	4				//magic, generation, ~generation, spare
+#define SETTINGS_RECORD_WORDS	3				//key, value, CRC16 of key and value
+#define SETTINGS_ERASED			0xFFFF
+#define SETTINGS_RECORD_SLOTS	((SETTINGS_PAGE_SIZE / 2 - SETTINGS_HEADER_WORDS) / SETTINGS_RECORD_WORDS)
+
+static uint16_t settingsValue[SETTINGS_KEY_COUNT];		//live value of every key
+static uint16_t settingsStored[SETTINGS_KEY_COUNT];		//newest value in flash
+static uint8_t settingsPresent[SETTINGS_KEY_COUNT];		//key has a record in flash
+static uint8_t settingsDirty[SETTINGS_KEY_COUNT];		//live value still has to be written
+static uint8_t settingsPending = 0;						//number of dirty keys
+static uint32_t settingsFirstChange = 0;				//tick of the oldest uncommitted change
+static uint32_t settingsLastChange = 0;					//tick of the newest change
+static uint8_t settingsPage = 0;						//page holding the newest records
+static uint16_t settingsGeneration = 0;					//generation of that page, bumped by every compaction
+static uint16_t settingsFreeSlot = 0;					//next unused record slot in that page
+
+uint32_t settingsEraseCount = 0;
+uint32_t settingsCommitCount = 0;
+uint16_t settingsQuietMs = SETTINGS_QUIET_MS;
+
+static uint32_t settingsSlotAddr(uint8_t page, uint16_t slot) {
+	return SETTINGS_BASE_ADDR + page * SETTINGS_PAGE_SIZE + (SETTINGS_HEADER_WORDS + slot * SETTINGS_RECORD_WORDS) * 2;
+}
+
+static uint16_t settingsRecordCrc(uint16_t key, uint16_t value) {
+	uint8_t buf[4] = { key & 0xFF, key >> 8, value & 0xFF, value >> 8 };
+
+	return modbusCrc16(buf, sizeof(buf));
+}
+
+/* A page counts only once its header is complete; the header is programmed last */
+static int8_t settingsPageValid(uint8_t page, uint16_t *generation) {
+	uint16_t header[SETTINGS_HEADER_WORDS];
+
+	STMFLASH_Read(SETTINGS_BASE_ADDR + page * SETTINGS_PAGE_SIZE, header, SETTINGS_HEADER_WORDS);
+	if (header[0] != SETTINGS_MAGIC || header[1] != (uint16_t)~header[2]) {
+		return 0;
+	}
+	*generation = header[1];
+	return 1;
+}
+
+/* Replay the log: later records overwrite earlier ones, torn or foreign records fail the CRC */
+static void settingsLoad(uint8_t page) {
+	uint16_t record[SETTINGS_RECORD_WORDS];
+	uint16_t slot;
+
+	for (slot = 0; slot < SETTINGS_RECORD_SLOTS; slot++) {
+		STMFLASH_Read(settingsSlotAddr(page, slot), record, SETTINGS_RECORD_WORDS);
+		if (record[0] == SETTINGS_ERASED) {
+			break;										//key is programmed first, so the log ends here
+		}
+		if (record[0] < SETTINGS_KEY_COUNT && record[2] == settingsRecordCrc(record[0], record[1])) {
+			settingsValue[record[0]] = record[1];
+			settingsStored[record[0]] = record[1];
+			settingsPresent[record[0]] = 1;
+		}
+	}
+	settingsFreeSlot = slot;
+}
+
+/* Flash must be unlocked */
+static void settingsAppend(uint8_t page, uint16_t slot, uint16_t key, uint16_t value) {
+	uint16_t record[SETTINGS_RECORD_WORDS];
+
+	record[0] = key;
+	record[1] = value;
+	record[2] = settingsRecordCrc(key, value);
+	STMFLASH_Write_NoCheck(settingsSlotAddr(page, slot), record, SETTINGS_RECORD_WORDS);
+}
+
+/* Copy the stored value of every key into the next page, then seal it with a newer generation. Flash must be unlocked */
+static void settingsCompact(void) {
+	uint8_t page = (settingsPage + 1) % SETTINGS_PAGE_COUNT;
+	uint16_t generation = settingsGeneration + 1;
+	uint16_t header[3];
+	uint16_t slot = 0;
+	uint16_t key;
+
+	STMFLASH_ErasePage(SETTINGS_BASE_ADDR + page * SETTINGS_PAGE_SIZE);
+	settingsEraseCount++;
+
+	for (key = 0; key < SETTINGS_KEY_COUNT; key++) {
+		if (settingsPresent[key]) {
+			settingsAppend(page, slot++, key, settingsStored[key]);
+		}
+	}
+
+	header[0] = SETTINGS_MAGIC;
+	header[1] = generation;
+	header[2] = ~generation;
+	STMFLASH_Write_NoCheck(SETTINGS_BASE_ADDR + page * SETTINGS_PAGE_SIZE, header, 3);
+
+	settingsPage = page;
+	settingsGeneration = generation;
+	settingsFreeSlot = slot;
+}
+
+/**
+  * Find the page with the newest generation and replay its records.
+  * Returns 0 when a store was found, 1 when none was and an empty one was formatted.
+  */
+int8_t settingsInit(void) {
+	uint16_t generation;
+	uint8_t page;
+	uint8_t found = 0;
+
+	memset(settingsPresent, 0, sizeof(settingsPresent));
+	memset(settingsDirty, 0, sizeof(settingsDirty));
+	settingsPending = 0;
+
+	for (page = 0; page < SETTINGS_PAGE_COUNT; page++) {
+		if (settingsPageValid(page, &generation) && (!found || (int16_t)(generation - settingsGeneration) > 0)) {
+			settingsPage = page;
+			settingsGeneration = generation;
+			found = 1;
+		}
+	}
+
+	if (!found) {
+		settingsPage = SETTINGS_PAGE_COUNT - 1;			//so the compaction formats page 0
+		settingsGeneration = 0;
+		HAL_FLASH_Unlock();
+		settingsCompact();
+		HAL_FLASH_Lock();
+		return 1;
+	}
+
+	settingsLoad(settingsPage);
+	return 0;
+}
+
+uint16_t settingsGet(uint16_t key, uint16_t defaultValue) {
+	if (key >= SETTINGS_KEY_COUNT || !(settingsPresent[key] || settingsDirty[key])) {
+		return defaultValue;
+	}
+	return settingsValue[key];
+}
+
+/* Only updates the live value and marks the key dirty; settingsHandle writes it once the changes settle */
+int8_t settingsSet(uint16_t key, uint16_t value) {
+	uint8_t dirty;
+
+	if (key >= SETTINGS_KEY_COUNT) {
+		return -1;
+	}
+	if (settingsValue[key] == value && (settingsPresent[key] || settingsDirty[key])) {
+		return 0;
+	}
+
+	settingsValue[key] = value;
+	dirty = !settingsPresent[key] || settingsStored[key] != value;	//set back to the stored value: nothing to write
+
+	if (dirty && !settingsDirty[key]) {
+		if (settingsPending++ == 0) {
+			settingsFirstChange = HAL_GetTick();
+		}
+	}
+	else if (!dirty && settingsDirty[key]) {
+		settingsPending--;
+	}
+	settingsDirty[key] = dirty;
+	settingsLastChange = HAL_GetTick();
+
+	return 0;
+}
+
+/* Write every dirty key now: one record each, and at most one page erase */
+void settingsCommit(void) {
+	uint16_t key;
+
+	if (settingsPending == 0) {
+		return;
+	}
+
+	HAL_FLASH_Unlock();
+	for (key = 0; key < SETTINGS_KEY_COUNT; key++) {
+		if (!settingsDirty[key]) {
+			continue;
+		}
+		if (settingsFreeSlot >= SETTINGS_RECORD_SLOTS) {
+			settingsCompact();
+		}
+		settingsAppend(settingsPage, settingsFreeSlot++, key, settingsValue[key]);
+		settingsStored[key] = settingsValue[key];
+		settingsPresent[key] = 1;
+		settingsDirty[key] = 0;
+	}
+	HAL_FLASH_Lock();
+
+	settingsPending = 0;
+	settingsCommitCount++;
+}
+
+/**
+  * Call from the main loop. Commits once no key has changed for settingsQuietMs,
+  * so a burst of changes costs one write, or SETTINGS_MAX_DEFER_MS after the first
+  * change if they never settle.
+  */
+void settingsHandle(void) {
+	uint32_t now;
+
+	if (settingsPending == 0) {
+		return;
+	}
+
+	now = HAL_GetTick();
+	if (now - settingsLastChange < settingsQuietMs && now - settingsFirstChange < SETTINGS_MAX_DEFER_MS) {
+		return;
+	}
+
+	settingsCommit();
+}
+
+/* FC04 on key addr - SETTINGS_MODBUS_BASE: its live value, 0xFFFF while it has none */
+int8_t settingsInputRegister(uint16_t addr, uint16_t *value) {
+	if (addr < SETTINGS_MODBUS_BASE || addr >= SETTINGS_MODBUS_BASE + SETTINGS_KEY_COUNT) {
+		return -1;
+	}
+	*value = settingsGet(addr - SETTINGS_MODBUS_BASE, 0xFFFF);
+	return 0;
+}
+
+/**
+  * FC06 on key addr - SETTINGS_MODBUS_BASE, committed like any other change.
+  * The setpoints are refused: userHandle copies localArray[5]/[6] over them, so
+  * they are written through holding registers 5 and 6 instead.
+  */
+int8_t settingsHoldingWrite(uint16_t addr, uint16_t value) {
+	if (addr < SETTINGS_MODBUS_BASE + SETTINGS_KEY_DEADBAND_WENDU || addr >= SETTINGS_MODBUS_BASE + SETTINGS_KEY_COUNT) {
+		return -1;
+	}
+	return settingsSet(addr - SETTINGS_MODBUS_BASE, value);
+}
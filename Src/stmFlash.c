@@ -16,6 +16,7 @@
 */
 /* ͷļ ----------------------------------------------------------------*/
 #include "stmFlash.h"
+#include "profile.h"
 
 /* ˽Ͷ --------------------------------------------------------------*/
 /* ˽к궨 ----------------------------------------------------------------*/
@@ -43,7 +44,7 @@ static FLASH_EraseInitTypeDef EraseInitStruct;
 */
 uint16_t STMFLASH_ReadHalfWord(uint32_t faddr)
 {
-	return *(__IO uint16_t*)faddr;
+	return *(__IO uint16_t*)(uintptr_t)faddr;
 }
 
 #if STM32_FLASH_WREN	//ʹд   
@@ -82,6 +83,7 @@ void STMFLASH_Write(uint32_t WriteAddr, uint16_t * pBuffer, uint16_t NumToWrite)
 	uint16_t i;
 	uint32_t secpos;	   //ַ
 	uint32_t offaddr;   //ȥ0X08000000ĵַ
+	PROFILE_SCOPE(PROFILE_FLASH_WRITE);
 
 	if (WriteAddr<FLASH_BASE || (WriteAddr >= (FLASH_BASE + 1024 * STM32_FLASH_SIZE)))return;//Ƿַ
 
@@ -133,6 +135,22 @@ void STMFLASH_Write(uint32_t WriteAddr, uint16_t * pBuffer, uint16_t NumToWrite)
 	};
 	HAL_FLASH_Lock();//
 }
+
+/**
+* : һ
+* : PageAddr:ʼַ
+*   ֵ: 
+* ˵    ǰȽFLASH
+*/
+void STMFLASH_ErasePage(uint32_t PageAddr)
+{
+	uint32_t SECTORError = 0;
+
+	EraseInitStruct.TypeErase = FLASH_TYPEERASE_PAGES;
+	EraseInitStruct.PageAddress = PageAddr;
+	EraseInitStruct.NbPages = 1;
+	HAL_FLASHEx_Erase(&EraseInitStruct, &SECTORError);
+}
 #endif
 
 /**
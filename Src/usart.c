@@ -42,17 +42,33 @@
 #include "gpio.h"
 
 /* USER CODE BEGIN 0 */
+#include "modbusCrc.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "log.h"
+#include <string.h>
 
-struct buffer Usart1ReceiveBuffer, Usart2ReceiveBuffer;
+struct buffer Usart1ReceiveBuffer[USART1_FRAME_SLOTS];
+struct buffer Usart2ReceiveBuffer;
 
-volatile uint8_t Usart1ReceiveState = 0;
 volatile uint8_t Usart2ReceiveState = 0;
+volatile uint32_t Usart1ReceiveDropped = 0;		//frames lost because the decoder still held every slot
 
+static uint8_t Usart1DmaBuffer[USART1_DMA_BUFFER_SIZE];
+static uint16_t Usart1DmaTail = 0;				//first ring position not yet handed to a frame slot
+static uint8_t Usart1ReceiveSlot = 0;			//slot the next frame is copied into
 
+static struct buffer Usart1TransmitBuffer[USART1_TX_SLOTS];
+static volatile uint8_t Usart1TransmitHead = 0;	//next slot to fill, advanced by the main loop
+static volatile uint8_t Usart1TransmitTail = 0;	//slot on the wire, advanced by the completion callback
+volatile uint32_t Usart1TransmitDropped = 0;	//replies refused because every slot was still queued
+
+
+/* printf and GIZWITS_LOG end here; queued for DMA, never waits for the port */
 int _write(int fd, char *pBuffer, int size)
 {
-	HAL_UART_Transmit(&huart3, pBuffer, size, 0xff);
-	return size;
+	logWrite((uint8_t *)pBuffer, size);
+	return size;								//a dropped write is counted by the log, not retried
 }
 
 /* USER CODE END 0 */
@@ -60,6 +76,11 @@ int _write(int fd, char *pBuffer, int size)
 UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart2;
 UART_HandleTypeDef huart3;
+DMA_HandleTypeDef hdma_usart1_rx;
+DMA_HandleTypeDef hdma_usart1_tx;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
+DMA_HandleTypeDef hdma_usart3_tx;
 
 /* USART1 init function */
 
@@ -145,11 +166,43 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     GPIO_InitStruct.Pull = GPIO_NOPULL;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+    /* USART1 DMA Init */
+    /* USART1_RX Init */
+    hdma_usart1_rx.Instance = DMA1_Channel5;
+    hdma_usart1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_usart1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart1_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart1_rx.Init.Mode = DMA_CIRCULAR;
+    hdma_usart1_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&hdma_usart1_rx) != HAL_OK)
+    {
+      _Error_Handler(__FILE__, __LINE__);
+    }
+
+    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart1_rx);
+
+    /* USART1_TX Init */
+    hdma_usart1_tx.Instance = DMA1_Channel4;
+    hdma_usart1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_usart1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart1_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart1_tx.Init.Mode = DMA_NORMAL;
+    hdma_usart1_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    if (HAL_DMA_Init(&hdma_usart1_tx) != HAL_OK)
+    {
+      _Error_Handler(__FILE__, __LINE__);
+    }
+
+    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart1_tx);
+
     /* USART1 interrupt Init */
     HAL_NVIC_SetPriority(USART1_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(USART1_IRQn);
   /* USER CODE BEGIN USART1_MspInit 1 */
-	__HAL_UART_ENABLE_IT(&huart1, UART_IT_RXNE);
 	__HAL_UART_ENABLE_IT(&huart1, UART_IT_IDLE);
   /* USER CODE END USART1_MspInit 1 */
   }
@@ -175,11 +228,44 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     GPIO_InitStruct.Pull = GPIO_NOPULL;
     HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+    /* USART2 DMA Init */
+    /* USART2_RX Init */
+    hdma_usart2_rx.Instance = DMA1_Channel6;
+    hdma_usart2_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_usart2_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart2_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart2_rx.Init.Mode = DMA_CIRCULAR;
+    hdma_usart2_rx.Init.Priority = DMA_PRIORITY_HIGH;
+    if (HAL_DMA_Init(&hdma_usart2_rx) != HAL_OK)
+    {
+      _Error_Handler(__FILE__, __LINE__);
+    }
+
+    __HAL_LINKDMA(uartHandle,hdmarx,hdma_usart2_rx);
+
+    /* USART2_TX Init */
+    hdma_usart2_tx.Instance = DMA1_Channel7;
+    hdma_usart2_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_usart2_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart2_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart2_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart2_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart2_tx.Init.Mode = DMA_NORMAL;
+    hdma_usart2_tx.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_usart2_tx) != HAL_OK)
+    {
+      _Error_Handler(__FILE__, __LINE__);
+    }
+
+    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart2_tx);
+
     /* USART2 interrupt Init */
     HAL_NVIC_SetPriority(USART2_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(USART2_IRQn);
   /* USER CODE BEGIN USART2_MspInit 1 */
-
+	__HAL_UART_ENABLE_IT(&huart2, UART_IT_IDLE);
   /* USER CODE END USART2_MspInit 1 */
   }
   else if(uartHandle->Instance==USART3)
@@ -204,6 +290,26 @@ void HAL_UART_MspInit(UART_HandleTypeDef* uartHandle)
     GPIO_InitStruct.Pull = GPIO_NOPULL;
     HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
+    /* USART3 DMA Init */
+    /* USART3_TX Init */
+    hdma_usart3_tx.Instance = DMA1_Channel2;
+    hdma_usart3_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_usart3_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_usart3_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_usart3_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_usart3_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_usart3_tx.Init.Mode = DMA_NORMAL;
+    hdma_usart3_tx.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&hdma_usart3_tx) != HAL_OK)
+    {
+      _Error_Handler(__FILE__, __LINE__);
+    }
+
+    __HAL_LINKDMA(uartHandle,hdmatx,hdma_usart3_tx);
+
+    /* USART3 interrupt Init */
+    HAL_NVIC_SetPriority(USART3_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(USART3_IRQn);
   /* USER CODE BEGIN USART3_MspInit 1 */
 
   /* USER CODE END USART3_MspInit 1 */
@@ -227,6 +333,10 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     */
     HAL_GPIO_DeInit(GPIOA, GPIO_PIN_9|GPIO_PIN_10);
 
+    /* USART1 DMA DeInit */
+    HAL_DMA_DeInit(uartHandle->hdmarx);
+    HAL_DMA_DeInit(uartHandle->hdmatx);
+
     /* USART1 interrupt Deinit */
     HAL_NVIC_DisableIRQ(USART1_IRQn);
   /* USER CODE BEGIN USART1_MspDeInit 1 */
@@ -247,6 +357,10 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     */
     HAL_GPIO_DeInit(GPIOA, GPIO_PIN_2|GPIO_PIN_3);
 
+    /* USART2 DMA DeInit */
+    HAL_DMA_DeInit(uartHandle->hdmarx);
+    HAL_DMA_DeInit(uartHandle->hdmatx);
+
     /* USART2 interrupt Deinit */
     HAL_NVIC_DisableIRQ(USART2_IRQn);
   /* USER CODE BEGIN USART2_MspDeInit 1 */
@@ -267,6 +381,11 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
     */
     HAL_GPIO_DeInit(GPIOB, GPIO_PIN_10|GPIO_PIN_11);
 
+    /* USART3 DMA DeInit */
+    HAL_DMA_DeInit(uartHandle->hdmatx);
+
+    /* USART3 interrupt Deinit */
+    HAL_NVIC_DisableIRQ(USART3_IRQn);
   /* USER CODE BEGIN USART3_MspDeInit 1 */
 
   /* USER CODE END USART3_MspDeInit 1 */
@@ -275,24 +394,149 @@ void HAL_UART_MspDeInit(UART_HandleTypeDef* uartHandle)
 
 /* USER CODE BEGIN 1 */
 
-void USART1_IRQHandler(void)
+/**
+  * USART1 bytes are moved by DMA1 channel 5 into a circular ring, no interrupt per byte.
+  * Only the IDLE line interrupt is enabled; it cuts the frame out of the ring.
+  */
+void usart1ReceiveInit(void)
 {
-	uint8_t Clear = Clear;
+	HAL_DMA_Start(&hdma_usart1_rx, (uint32_t)(uintptr_t)&huart1.Instance->DR, (uint32_t)(uintptr_t)Usart1DmaBuffer, USART1_DMA_BUFFER_SIZE);
+	SET_BIT(huart1.Instance->CR3, USART_CR3_DMAR);
+}
 
+/* Copy the bytes the DMA wrote since the last IDLE into a free frame slot, computing the CRC on the way */
+static void usart1ReceiveFrame(void)
+{
+	uint16_t head = (USART1_DMA_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(&hdma_usart1_rx)) & (USART1_DMA_BUFFER_SIZE - 1);
+	uint16_t len = (head - Usart1DmaTail) & (USART1_DMA_BUFFER_SIZE - 1);
+	struct buffer *slot = &Usart1ReceiveBuffer[Usart1ReceiveSlot];
+	uint16_t crc = MODBUS_CRC_INIT;
+	uint16_t i;
+	uint8_t data;
+
+	if (len == 0)
+	{
+		return;
+	}
+
+	if (slot->BufferReady)
+	{
+		Usart1ReceiveDropped++;
+		Usart1DmaTail = head;
+		return;
+	}
+
+	for (i = 0; i < len; i++)
+	{
+		data = Usart1DmaBuffer[Usart1DmaTail];
+		slot->BufferArray[i] = data;
+		crc = modbusCrcUpdate(crc, data);
+		Usart1DmaTail = (Usart1DmaTail + 1) & (USART1_DMA_BUFFER_SIZE - 1);
+	}
+	slot->BufferLen = len;
+	slot->BufferCrc = crc;
+	slot->BufferReady = 1;
+	Usart1ReceiveSlot = (Usart1ReceiveSlot + 1) % USART1_FRAME_SLOTS;
+	schedulerSignal(SCHEDULER_TASK_MODBUS);
+}
+
+#ifdef MODBUS_BENCH
+/* Hand a frame to the decoder exactly as usart1ReceiveFrame does, from a plain buffer instead of the DMA ring */
+int8_t usart1ReceiveInject(const uint8_t *buf, uint16_t len)
+{
+	struct buffer *slot = &Usart1ReceiveBuffer[Usart1ReceiveSlot];
+	uint16_t crc = MODBUS_CRC_INIT;
+	uint16_t i;
 
-	if (__HAL_UART_GET_FLAG(&huart1, UART_FLAG_RXNE) != RESET)
+	if (slot->BufferReady || len > sizeof(slot->BufferArray))
 	{
-		Usart1ReceiveBuffer.BufferArray[Usart1ReceiveBuffer.BufferLen++] = huart1.Instance->DR;
+		return -1;
 	}
 
-	if (__HAL_UART_GET_FLAG(&huart1, UART_FLAG_IDLE) != RESET)
+	for (i = 0; i < len; i++)
+	{
+		slot->BufferArray[i] = buf[i];
+		crc = modbusCrcUpdate(crc, buf[i]);
+	}
+	slot->BufferLen = len;
+	slot->BufferCrc = crc;
+	slot->BufferReady = 1;
+	Usart1ReceiveSlot = (Usart1ReceiveSlot + 1) % USART1_FRAME_SLOTS;
+	return 0;
+}
+#endif
+
+/* Start the oldest queued reply if the port is idle; caller keeps interrupts out */
+static void usart1TransmitNext(void)
+{
+	struct buffer *slot;
+
+	if ((Usart1TransmitHead == Usart1TransmitTail) || (huart1.gState != HAL_UART_STATE_READY))
+	{
+		return;
+	}
+
+	slot = &Usart1TransmitBuffer[Usart1TransmitTail % USART1_TX_SLOTS];
+	HAL_UART_Transmit_DMA(&huart1, slot->BufferArray, slot->BufferLen);
+}
+
+/**
+  * Queue a reply for DMA transmission and return at once.
+  * Returns 0 when queued, -1 when the frame is too long or the queue is full.
+  */
+int8_t usart1TransmitQueue(uint8_t *buf, uint16_t len)
+{
+	struct buffer *slot;
+	uint32_t primask;
+
+	if (len > sizeof(slot->BufferArray))
+	{
+		return -1;
+	}
+
+	if ((uint8_t)(Usart1TransmitHead - Usart1TransmitTail) >= USART1_TX_SLOTS)
+	{
+		Usart1TransmitDropped++;
+		return -1;
+	}
+
+	slot = &Usart1TransmitBuffer[Usart1TransmitHead % USART1_TX_SLOTS];
+	memcpy(slot->BufferArray, buf, len);
+	slot->BufferLen = len;
+	Usart1TransmitHead++;
+
+	primask = __get_PRIMASK();
+	__disable_irq();
+	usart1TransmitNext();
+	__set_PRIMASK(primask);
+
+	return 0;
+}
+
+/* Called from HAL_UART_TxCpltCallback once the last byte of a reply has left the shift register */
+void usart1TransmitCplt(void)
+{
+	Usart1TransmitTail++;
+	usart1TransmitNext();
+}
+
+void USART1_IRQHandler(void)
+{
+	PROFILE_SCOPE(PROFILE_ISR_USART1);
+	uint32_t isrflags = huart1.Instance->SR;
+	uint8_t Clear = Clear;
+
+	if (isrflags & USART_SR_IDLE)
 	{
-		Clear = huart1.Instance->SR;
-		Clear = huart1.Instance->DR;
-		Usart1ReceiveState = 1;
+		if (0 == (isrflags & USART_SR_RXNE))
+		{
+			Clear = huart1.Instance->DR;		//Ends the SR/DR sequence that clears IDLE, never steals a byte from the DMA
+		}
+		usart1ReceiveFrame();
 		HAL_GPIO_TogglePin(led1_GPIO_Port, led1_Pin);
 	}
 
+	HAL_UART_IRQHandler(&huart1);		//TC at the end of a DMA transmission
 }
 
 
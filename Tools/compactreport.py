@@ -0,0 +1,296 @@
+#!/usr/bin/env python3
+"""Compact status reports (gizCompactEncode in Gizwits/gizwits_protocol.c) on the host.
+
+    compactreport.py bench capture.bin [--keyframe N]
+    compactreport.py decode capture.bin [--quiet]
+
+A capture is the MCU to GAgent byte stream (USART2 TX), e.g. the host build's
+GAgent PTY or a logic analyser dump.
+
+bench   takes the P0 status reports of a capture made with compact reports off,
+        encodes them the way the firmware would, decodes them again, checks the
+        round trip and prints the bytes on the wire for both formats.
+decode  prints the fields of every compact frame in a capture made with
+        SETTINGS_KEY_COMPACT_REPORT set, the way a cloud side decoder would,
+        and the age of the reports replayed from the backlog; --quiet prints
+        only the totals. Fails on a sequence gap or a frame that does not
+        decode.
+
+"make -C Host test" runs both over the traces in Host/Test/Traces.
+
+The field table is read from the firmware sources, so the tool follows changes
+to gizDataPoints[] and devStatus_t.
+"""
+
+import os
+import re
+import sys
+
+CMD_REPORT_P0 = 0x05
+ACTION_REPORT_DEV_STATUS = 0x04
+ACTION_D2W_TRANSPARENT_DATA = 0x06
+
+GIZ_COMPACT_KEY = 0x40
+GIZ_COMPACT_DELTA = 0x80
+GIZ_COMPACT_REPLAY = 0xC0
+GIZ_COMPACT_SEQ = 0x3F
+REPORT_KEYFRAME_NUM = 32
+ACK_WINDOW_SIZE = 4     # frames in flight, so a resend is at most this far behind
+
+FRAME_OVERHEAD = 10     # header, length, cmd, sn, flags, action, checksum
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+SIZES = {"uint8_t": 1, "uint16_t": 2}
+
+
+class Field:
+    def __init__(self, name, kind, offset, bit=0, width=1):
+        self.name = name
+        self.kind = kind
+        self.offset = offset
+        self.bit = bit
+        self.width = width
+
+
+def load_fields(root=ROOT):
+    """gizDataPoints[] in table order, with the devStatus_t layout of every field"""
+    with open(os.path.join(root, "Gizwits", "gizwits_protocol.h"), encoding="utf-8") as f:
+        header = f.read()
+    with open(os.path.join(root, "Gizwits", "gizwits_protocol.c"), encoding="utf-8") as f:
+        source = f.read()
+
+    defines = dict(re.findall(r"^#define\s+(\w+)\s+(\d+)", header, re.M))
+    body = re.search(r"typedef struct\s*\{([^}]*)\}\s*devStatus_t;", header).group(1)
+    offsets = {}
+    offset = 0
+    for ctype, name, count in re.findall(r"(uint8_t|uint16_t)\s+(\w+)(?:\[(\w+)\])?;", body):
+        offsets[name] = offset
+        offset += SIZES[ctype] * int(defines.get(count, count or 1))
+    size = offset
+
+    fields = []
+    table = source[source.index("gizDataPoints[] ="):]
+    table = table[:table.index("};")]
+    for kind, name in re.findall(r"GIZ_DP_(BOOL|VALUE)_[WR]\((\w+)", table):
+        if kind == "BOOL":
+            byte = int(defines[name + "_BYTEOFFSET"])
+            buf = "wBitBuf" if byte < offsets["rBitBuf"] else "rBitBuf"
+            fields.append(Field(name, "bool", byte, int(defines[name + "_BITOFFSET"]), int(defines[name + "_LEN"])))
+            fields[-1].buf = buf
+        else:
+            fields.append(Field(name, "value", offsets["value" + name]))
+    return fields, size, offsets
+
+
+class Codec:
+    def __init__(self, root=ROOT):
+        self.fields, self.size, self.offsets = load_fields(root)
+        self.bufs = {
+            "wBitBuf": (self.offsets["wBitBuf"], self.offsets["valueWenDuSet"] - self.offsets["wBitBuf"]),
+            "rBitBuf": (self.offsets["rBitBuf"], self.offsets["valueWenDuZhi"] - self.offsets["rBitBuf"]),
+        }
+
+    def bit_byte(self, field):
+        start, length = self.bufs[field.buf]
+        return start + length - 1 - (field.offset - start)     # the bit buffers are byte swapped
+
+    def get(self, status, field):
+        if field.kind == "value":
+            return (status[field.offset] << 8) | status[field.offset + 1]
+        return (status[self.bit_byte(field)] >> field.bit) & ((1 << field.width) - 1)
+
+    def put(self, status, field, value):
+        if field.kind == "value":
+            status[field.offset] = (value >> 8) & 0xFF
+            status[field.offset + 1] = value & 0xFF
+        else:
+            mask = ((1 << field.width) - 1) << field.bit
+            byte = self.bit_byte(field)
+            status[byte] = (status[byte] & ~mask) | ((value << field.bit) & mask)
+
+    def encode(self, cur, last, key, seq):
+        changed = 0
+        for i, field in enumerate(self.fields):
+            if key or self.get(cur, field) != self.get(last, field):
+                changed |= 1 << i
+        out = bytearray([(GIZ_COMPACT_KEY if key else GIZ_COMPACT_DELTA) | (seq & GIZ_COMPACT_SEQ)])
+        if not key:
+            out += varint(changed)
+        for i, field in enumerate(self.fields):
+            if changed & (1 << i):
+                value = self.get(cur, field)
+                if not key and field.kind == "value":
+                    delta = value - self.get(last, field)
+                    value = ((delta << 1) ^ (delta >> 31)) & 0xFFFFFFFF
+                out += varint(value)
+        return bytes(out)
+
+    def decode(self, payload, last):
+        """(status after the frame, age in seconds or None); last is the receiver's status, used by a delta only"""
+        kind = payload[0] & ~GIZ_COMPACT_SEQ
+        pos = 1
+        age = None
+        status = bytearray(last) if kind == GIZ_COMPACT_DELTA else bytearray(self.size)
+        if kind == GIZ_COMPACT_REPLAY:
+            age, pos = unvarint(payload, pos)
+            age = age - 1 if age else None          # 0: taken before a reset, unknown
+        if kind in (GIZ_COMPACT_KEY, GIZ_COMPACT_REPLAY):
+            changed = (1 << len(self.fields)) - 1
+        elif kind == GIZ_COMPACT_DELTA:
+            changed, pos = unvarint(payload, pos)
+        else:
+            raise ValueError("not a compact frame")
+        for i, field in enumerate(self.fields):
+            if changed & (1 << i):
+                value, pos = unvarint(payload, pos)
+                if kind == GIZ_COMPACT_DELTA and field.kind == "value":
+                    value = (self.get(status, field) + ((value >> 1) ^ -(value & 1))) & 0xFFFF
+                self.put(status, field, value)
+        if pos != len(payload):
+            raise ValueError("%d bytes left over" % (len(payload) - pos))
+        return bytes(status), age
+
+
+def varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return out
+
+
+def unvarint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+
+def frames(data):
+    """De-stuffed frames of an MCU to GAgent stream: (cmd, sn, payload after the flags)"""
+    i = 0
+    while i + 1 < len(data):
+        if data[i] != 0xFF or data[i + 1] != 0xFF:
+            i += 1
+            continue
+        body = bytearray()
+        j = i + 2
+        need = None
+        while j < len(data) and (need is None or len(body) < need):
+            body.append(data[j])
+            if data[j] == 0xFF and j + 1 < len(data) and data[j + 1] == 0x55:
+                j += 1
+            j += 1
+            if need is None and len(body) == 2:
+                need = 2 + ((body[0] << 8) | body[1])
+        if need is None or len(body) < need:
+            return
+        if sum(body[:-1]) & 0xFF == body[-1]:
+            yield body[2], body[3], bytes(body[6:-1])
+        i = j
+
+
+def wire_size(payload):
+    """Frame bytes on the line for a payload behind CMD_REPORT_P0, 0xFF 0x55 stuffing included"""
+    return FRAME_OVERHEAD + len(payload) + payload.count(0xFF)
+
+
+def bench(codec, data, keyframe):
+    reports = [p[1:] for cmd, sn, p in frames(data) if cmd == CMD_REPORT_P0 and p[:1] == bytes([ACTION_REPORT_DEV_STATUS])]
+    if not reports:
+        print("no status reports in the capture")
+        return 1
+    last = bytes(codec.size)
+    held = bytes(codec.size)
+    standard = 0
+    compact = 0
+    sizes = {}
+    for n, status in enumerate(reports):
+        payload = codec.encode(status, last, n % keyframe == 0, n)
+        held = codec.decode(payload, held)[0]
+        if held != status:
+            print("round trip failed at report %d" % n)
+            return 1
+        last = status
+        standard += wire_size(bytes([ACTION_REPORT_DEV_STATUS]) + status)
+        compact += wire_size(bytes([ACTION_D2W_TRANSPARENT_DATA]) + payload)
+        sizes[len(payload)] = sizes.get(len(payload), 0) + 1
+    print("%d status reports, keyframe every %d, round trip ok" % (len(reports), keyframe))
+    print("standard: %6d bytes, %5.1f per report" % (standard, standard / len(reports)))
+    print("compact:  %6d bytes, %5.1f per report, %.1f%% saved" % (compact, compact / len(reports), 100.0 * (standard - compact) / standard))
+    print("compact payload sizes: " + ", ".join("%dB x%d" % item for item in sorted(sizes.items())))
+    return 0
+
+
+def decode(codec, data, quiet):
+    status = None
+    expect = None
+    counts = {GIZ_COMPACT_KEY: 0, GIZ_COMPACT_DELTA: 0, GIZ_COMPACT_REPLAY: 0}
+    errors = 0
+    for cmd, sn, payload in frames(data):
+        if cmd != CMD_REPORT_P0 or payload[:1] != bytes([ACTION_D2W_TRANSPARENT_DATA]) or len(payload) < 2:
+            continue
+        payload = payload[1:]
+        seq = payload[0] & GIZ_COMPACT_SEQ
+        kind = payload[0] & ~GIZ_COMPACT_SEQ
+        if expect is not None and (expect - 1 - seq) & GIZ_COMPACT_SEQ < ACK_WINDOW_SIZE:
+            continue                                # a resend of a frame already seen
+        if expect is not None and seq != expect:
+            print("seq %d: gap, expected %d" % (seq, expect))
+            errors += 1
+            status = None
+        expect = (seq + 1) & GIZ_COMPACT_SEQ
+        if status is None and kind == GIZ_COMPACT_DELTA:
+            print("seq %d: delta without a keyframe, skipped" % seq)
+            errors += 1
+            continue
+        try:
+            status, age = codec.decode(payload, status)
+        except (ValueError, IndexError) as e:
+            print("seq %d: %s" % (seq, e))
+            errors += 1
+            status = None
+            continue
+        counts[kind] += 1
+        if quiet:
+            continue
+        name = {GIZ_COMPACT_KEY: "key", GIZ_COMPACT_DELTA: "delta", GIZ_COMPACT_REPLAY: "replay"}[kind]
+        print("seq %2d %-6s %2dB: %s%s" % (seq, name, len(payload),
+                                           " ".join("%s=%d" % (f.name, codec.get(status, f)) for f in codec.fields),
+                                           "" if kind != GIZ_COMPACT_REPLAY else
+                                           " (age %s)" % ("%ds" % age if age is not None else "unknown")))
+    print("%d compact frames: %d key, %d delta, %d replay, %d errors" % (sum(counts.values()), counts[GIZ_COMPACT_KEY],
+                                                                     counts[GIZ_COMPACT_DELTA], counts[GIZ_COMPACT_REPLAY], errors))
+    return 1 if errors or not sum(counts.values()) else 0
+
+
+def main():
+    args = sys.argv[1:]
+    keyframe = REPORT_KEYFRAME_NUM
+    if "--keyframe" in args:
+        i = args.index("--keyframe")
+        keyframe = int(args[i + 1])
+        del args[i:i + 2]
+    quiet = "--quiet" in args
+    if quiet:
+        args.remove("--quiet")
+    if len(args) != 2 or args[0] not in ("bench", "decode"):
+        sys.stderr.write(__doc__)
+        return 2
+    with open(args[1], "rb") as f:
+        data = f.read()
+    codec = Codec()
+    if args[0] == "bench":
+        return bench(codec, data, keyframe)
+    return decode(codec, data, quiet)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Turn a USART3 capture of a LOG_TOKENIZED=1 build back into text.
+
+    logdecode.py GPRS.elf capture.bin
+    stty -F /dev/ttyUSB0 115200 raw && logdecode.py GPRS.elf /dev/ttyUSB0
+    ./GPRS-host | logdecode.py GPRS-host
+
+The record format is described in Inc/log.h. Format strings come from the
+.logfmt section of the ELF, %s arguments from its loaded sections (strings in
+flash); anything else in the stream is copied through as text. Works with the
+ARM image and with the host build (Host/Makefile), 32 or 64 bit ELF.
+"""
+
+import os
+import re
+import struct
+import sys
+
+LOG_TOKEN_SYNC = 0xF0
+LOG_TOKEN_ARGS = 8
+
+SHT_NOBITS = 8
+SHF_ALLOC = 0x2
+
+CONVERSION = re.compile(r"%([-+ #0]*)(\d+|\*)?(?:\.(\d+|\*))?(?:hh|h|ll|l|j|z|t|L)?([diouxXcspn%])")
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[5] != 1:
+            raise ValueError("%s: not a little-endian ELF file" % path)
+        if data[4] == 1:
+            shoff, = struct.unpack_from("<I", data, 0x20)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+            header = "<IIIIIIIIII"
+        else:
+            shoff, = struct.unpack_from("<Q", data, 0x28)
+            shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x3A)
+            header = "<IIQQQQIIQQ"
+
+        sections = []
+        for i in range(shnum):
+            name, stype, flags, addr, offset, size = struct.unpack_from(header, data, shoff + i * shentsize)[:6]
+            sections.append((name, stype, flags, addr, offset, size))
+        names = sections[shstrndx][4]
+
+        self.logfmt = None
+        self.loaded = []
+        for name, stype, flags, addr, offset, size in sections:
+            name = data[names + name:data.index(b"\0", names + name)].decode()
+            contents = data[offset:offset + size] if stype != SHT_NOBITS else b""
+            if name == ".logfmt":
+                self.logfmt = contents
+            elif flags & SHF_ALLOC and contents:
+                self.loaded.append((addr, contents))
+        if self.logfmt is None:
+            raise ValueError("%s: no .logfmt section, not a LOG_TOKENIZED=1 build" % path)
+
+    def format(self, token):
+        end = self.logfmt.find(b"\0", token)
+        if token >= len(self.logfmt) or end < 0:
+            return None
+        return self.logfmt[token:end].decode("latin-1")
+
+    def string(self, addr):
+        for base, contents in self.loaded:
+            if base <= addr < base + len(contents):
+                end = contents.find(b"\0", addr - base)
+                if end >= 0:
+                    return contents[addr - base:end].decode("latin-1")
+        return "<0x%08x>" % addr
+
+
+def render(elf, fmt, args):
+    """printf(fmt, args...) with every argument a raw 32-bit value"""
+    args = list(args)
+
+    def take():
+        return args.pop(0) if args else 0
+
+    def convert(m):
+        flags, width, precision, conv = m.groups()
+        if conv == "%":
+            return "%"
+        if width == "*":
+            width = str(struct.unpack("<i", struct.pack("<I", take()))[0])
+        if precision == "*":
+            precision = str(take())
+        spec = "%" + flags + (width or "") + ("." + precision if precision else "")
+        value = take()
+        if conv in "di":
+            return (spec + "d") % struct.unpack("<i", struct.pack("<I", value))[0]
+        if conv == "u":
+            return (spec + "d") % value
+        if conv in "oxX":
+            return (spec + conv) % value
+        if conv == "c":
+            return (spec + "c") % (value & 0xFF)
+        if conv == "s":
+            return (spec + "s") % elf.string(value)
+        if conv == "p":
+            return "0x%08x" % value
+        return ""
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def decode(elf, stream, out):
+    pending = b""
+    while True:
+        chunk = os.read(stream, 4096)
+        if not chunk:
+            break
+        pending += chunk
+        text = []
+        i = 0
+        while i < len(pending):
+            byte = pending[i]
+            count = byte - LOG_TOKEN_SYNC
+            if not 0 <= count <= LOG_TOKEN_ARGS:
+                text.append(chr(byte))
+                i += 1
+                continue
+            size = 3 + count * 4
+            if i + size > len(pending):
+                break                                   # rest of the record is still on the wire
+            token, = struct.unpack_from("<H", pending, i + 1)
+            args = struct.unpack_from("<%dI" % count, pending, i + 3)
+            fmt = elf.format(token)
+            if fmt is None:
+                text.append("<bad token 0x%04x>\n" % token)
+            else:
+                text.append(render(elf, fmt, args))
+            i += size
+        pending = pending[i:]
+        out.write("".join(text))
+        out.flush()
+
+
+def main():
+    if len(sys.argv) not in (2, 3):
+        sys.stderr.write("usage: %s firmware.elf [capture|tty|-]\n" % sys.argv[0])
+        return 2
+    elf = Elf(sys.argv[1])
+    if len(sys.argv) == 2 or sys.argv[2] == "-":
+        stream = sys.stdin.fileno()
+    else:
+        stream = os.open(sys.argv[2], os.O_RDONLY)
+    try:
+        decode(elf, stream, sys.stdout)
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
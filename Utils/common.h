@@ -26,6 +26,7 @@ extern "C" {
 #include <string.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include "log.h"
 
 #ifndef ICACHE_FLASH_ATTR
 #define ICACHE_FLASH_ATTR
@@ -37,7 +38,7 @@ typedef void (*gizTimerFunc_t)(void *arg );
 * @name Log print macro definition
 * @{
 */
-#define GIZWITS_LOG printf                          ///<Run log print
+#define GIZWITS_LOG LOG_INFO                        ///<Run log print, see LOG_ERROR..LOG_DEBUG in log.h
 //#define PROTOCOL_DEBUG                              ///<Protocol data print
 
 #ifndef GIZWITS_LOG_NOFORMAT
@@ -27,14 +27,24 @@ extern "C" {
 
 #define min(a, b) (a)<(b)?(a):(b)                   ///< Calculate the minimum value
 
-#pragma pack(1)
+/**
+* Orders the buffer accesses against the index update on the other side.
+* The ring has exactly one writer (an interrupt) and one reader (the main loop),
+* each index is only ever stored by its owner, so no lock is needed.
+*/
+#if defined(__arm__)
+#define rbBarrier() __asm volatile ("dmb" ::: "memory")
+#else
+#define rbBarrier() __sync_synchronize()
+#endif
+
 typedef struct {
-    size_t rbCapacity;
-    uint8_t  *rbHead;
-    uint8_t  *rbTail;
+    size_t rbCapacity;                              ///< Buffer size, must be a power of two
+    volatile uint32_t rbHead;                       ///< Free-running read index, stored by the reader only
+    volatile uint32_t rbTail;                       ///< Free-running write index, stored by the writer only
+    uint32_t rbDropped;                             ///< Unread bytes a writer ran over, stored by the reader only
     uint8_t  *rbBuff;
 }rb_t;
-#pragma pack()
 
 int8_t rbCreate(rb_t* rb);
 int8_t rbDelete(rb_t* rb);
@@ -43,6 +53,10 @@ int32_t rbCanRead(rb_t *rb);
 int32_t rbCanWrite(rb_t *rb);
 int32_t rbRead(rb_t *rb, void *data, size_t count);
 int32_t rbWrite(rb_t *rb, const void *data, size_t count);
+int32_t rbPeek(rb_t *rb, uint8_t **data);
+int32_t rbCommit(rb_t *rb, size_t count);
+int32_t rbReserve(rb_t *rb, uint8_t **data);
+int32_t rbPublish(rb_t *rb, size_t count);
 
 #ifdef __cplusplus
 }
@@ -18,13 +18,19 @@
 
 int8_t ICACHE_FLASH_ATTR rbCreate(rb_t* rb)
 {
-    if(NULL == rb)
+    if((NULL == rb)||(NULL == rb->rbBuff))
+    {
+        return -1;
+    }
+
+    if((0 == rb->rbCapacity)||(0 != (rb->rbCapacity & (rb->rbCapacity - 1))))
     {
         return -1;
     }
 
-    rb->rbHead = rb->rbBuff;
-    rb->rbTail = rb->rbBuff;
+    rb->rbHead = 0;
+    rb->rbTail = 0;
+    rb->rbDropped = 0;
     return 0;
 }
 
@@ -36,10 +42,11 @@ int8_t ICACHE_FLASH_ATTR rbDelete(rb_t* rb)
     }
 
     rb->rbBuff = NULL;
-    rb->rbHead = NULL;
-    rb->rbTail = NULL;
+    rb->rbHead = 0;
+    rb->rbTail = 0;
+    rb->rbDropped = 0;
     rb->rbCapacity = 0;
-		return 0;
+    return 0;
 }
 
 int32_t ICACHE_FLASH_ATTR rbCapacity(rb_t *rb)
@@ -59,109 +66,167 @@ int32_t ICACHE_FLASH_ATTR rbCanRead(rb_t *rb)
         return -1;
     }
 
-    if (rb->rbHead == rb->rbTail)
+    return min(rb->rbTail - rb->rbHead, rb->rbCapacity);
+}
+
+int32_t ICACHE_FLASH_ATTR rbCanWrite(rb_t *rb)
+{
+    if(NULL == rb)
     {
-        return 0;
+        return -1;
     }
 
-    if (rb->rbHead < rb->rbTail)
+    return rbCapacity(rb) - rbCanRead(rb);
+}
+
+/**
+ * Reader side: contiguous readable span starting at the read index.
+ * After an overrun the span is empty and rbDropped has grown; a reader that parses
+ * a stream compares rbDropped between calls to learn that its bytes are not contiguous.
+ */
+int32_t ICACHE_FLASH_ATTR rbPeek(rb_t *rb, uint8_t **data)
+{
+    uint32_t head = 0;
+    uint32_t count = 0;
+    uint32_t offset = 0;
+
+    if((NULL == rb)||(NULL == data))
+    {
+        return -1;
+    }
+
+    head = rb->rbHead;
+    count = rb->rbTail - head;
+    if (count > rb->rbCapacity)
     {
-        return rb->rbTail - rb->rbHead;
+        //The writer ran over unread bytes, drop everything and restart at its position
+        head += count;
+        rb->rbHead = head;
+        rb->rbDropped += count;
+        count = 0;
     }
+    rbBarrier();                                    //Bytes below rbTail are in place before they are read
+
+    offset = head & (rb->rbCapacity - 1);
+    *data = rb->rbBuff + offset;
 
-    return rbCapacity(rb) - (rb->rbHead - rb->rbTail);
+    return min(count, rb->rbCapacity - offset);
 }
 
-int32_t ICACHE_FLASH_ATTR rbCanWrite(rb_t *rb)
+/* Reader side: release count bytes back to the writer */
+int32_t ICACHE_FLASH_ATTR rbCommit(rb_t *rb, size_t count)
 {
+    uint32_t canRead = 0;
+
     if(NULL == rb)
     {
         return -1;
     }
 
-    return rbCapacity(rb) - rbCanRead(rb);
+    canRead = rbCanRead(rb);
+    if (count > canRead)
+    {
+        count = canRead;
+    }
+
+    rbBarrier();                                    //Finish reading before the writer may reuse the bytes
+    rb->rbHead += count;
+
+    return count;
 }
 
-int32_t ICACHE_FLASH_ATTR rbRead(rb_t *rb, void *data, size_t count)
+/* Writer side: contiguous free span starting at the write index */
+int32_t ICACHE_FLASH_ATTR rbReserve(rb_t *rb, uint8_t **data)
 {
-    int copySz = 0;
+    uint32_t tail = 0;
+    uint32_t count = 0;
+    uint32_t offset = 0;
 
-    if(NULL == rb)
+    if((NULL == rb)||(NULL == data))
     {
         return -1;
     }
 
-    if(NULL == data)
+    tail = rb->rbTail;
+    count = rbCanWrite(rb);
+    rbBarrier();                                    //The reader is done with bytes below rbHead before they are overwritten
+
+    offset = tail & (rb->rbCapacity - 1);
+    *data = rb->rbBuff + offset;
+
+    return min(count, rb->rbCapacity - offset);
+}
+
+/**
+ * Writer side: hand count freshly written bytes to the reader.
+ * A writer that cannot wait, such as a circular DMA, may publish past the free space;
+ * the reader then drops the overwritten bytes on its next rbPeek.
+ */
+int32_t ICACHE_FLASH_ATTR rbPublish(rb_t *rb, size_t count)
+{
+    if(NULL == rb)
     {
         return -1;
     }
 
-    if (rb->rbHead < rb->rbTail)
+    rbBarrier();                                    //Data lands before the index that exposes it
+    rb->rbTail += count;
+
+    return count;
+}
+
+int32_t ICACHE_FLASH_ATTR rbRead(rb_t *rb, void *data, size_t count)
+{
+    int32_t copySz = 0;
+    int32_t spanSz = 0;
+    uint8_t *span = NULL;
+
+    if((NULL == rb)||(NULL == data))
     {
-        copySz = min(count, rbCanRead(rb));
-        memcpy(data, rb->rbHead, copySz);
-        rb->rbHead += copySz;
-        return copySz;
+        return -1;
     }
-    else
+
+    while (copySz < count)
     {
-        if (count < rbCapacity(rb)-(rb->rbHead - rb->rbBuff))
-        {
-            copySz = count;
-            memcpy(data, rb->rbHead, copySz);
-            rb->rbHead += copySz;
-            return copySz;
-        }
-        else
+        spanSz = rbPeek(rb, &span);
+        if (spanSz <= 0)
         {
-            copySz = rbCapacity(rb) - (rb->rbHead - rb->rbBuff);
-            memcpy(data, rb->rbHead, copySz);
-            rb->rbHead = rb->rbBuff;
-            copySz += rbRead(rb, (char*)data+copySz, count-copySz);
-            return copySz;
+            break;
         }
+
+        spanSz = min(spanSz, count - copySz);
+        memcpy((uint8_t *)data + copySz, span, spanSz);
+        rbCommit(rb, spanSz);
+        copySz += spanSz;
     }
+
+    return copySz;
 }
 
 int32_t ICACHE_FLASH_ATTR rbWrite(rb_t *rb, const void *data, size_t count)
 {
-    int tailAvailSz = 0;
+    int32_t copySz = 0;
+    int32_t spanSz = 0;
+    uint8_t *span = NULL;
 
     if((NULL == rb)||(NULL == data))
     {
         return -1;
     }
 
-    if (count >= rbCanWrite(rb))
+    if (count > rbCanWrite(rb))
     {
         return -2;
     }
 
-    if (rb->rbHead <= rb->rbTail)
+    while (copySz < count)
     {
-        tailAvailSz = rbCapacity(rb) - (rb->rbTail - rb->rbBuff);
-        if (count <= tailAvailSz)
-        {
-            memcpy(rb->rbTail, data, count);
-            rb->rbTail += count;
-            if (rb->rbTail == rb->rbBuff+rbCapacity(rb))
-            {
-                rb->rbTail = rb->rbBuff;
-            }
-            return count;
-        }
-        else
-        {
-            memcpy(rb->rbTail, data, tailAvailSz);
-            rb->rbTail = rb->rbBuff;
-
-            return tailAvailSz + rbWrite(rb, (char*)data+tailAvailSz, count-tailAvailSz);
-        }
-    }
-    else
-    {
-        memcpy(rb->rbTail, data, count);
-        rb->rbTail += count;
-        return count;
+        spanSz = rbReserve(rb, &span);
+        spanSz = min(spanSz, count - copySz);
+        memcpy(span, (const uint8_t *)data + copySz, spanSz);
+        rbPublish(rb, spanSz);
+        copySz += spanSz;
     }
+
+    return copySz;
 }